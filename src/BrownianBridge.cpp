@@ -2,7 +2,12 @@
  * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
  */
 #include "plugin.hpp"
-#include <array>
+#include "TriggerBank.hpp"
+#include "dsp/BrownianBridge.hpp"
+#include "SeedSetting.hpp"
+#include "ProcessVariants.hpp"
+#include "Instrument.hpp"
+#include "StateBlob.hpp"
 
 struct BrownianBridge : Module {
 
@@ -26,11 +31,15 @@ struct BrownianBridge : Module {
 		NUM_OUTPUTS
 	};
 
-	float outsignal[16] = {0};
-	float internaltime[16] = {0};
-	float internalmaxtime[16] = {5};
-	std::array<rack::dsp::SchmittTrigger,16> inputTrigger;
-	float sqrtdelta = 1.0/std::sqrt(APP->engine->getSampleRate());
+	TriggerBank inputTrigger;
+	zcdsp::Bridge bridge{random::u64()};
+	SeedSetting seed{&bridge.rng};
+
+	// process() runs the variant for the CV inputs patched, RANGE_INPUT..TIME_INPUT
+	uint32_t cvMask = ~0u;
+	zcdsp::Bridge::ProcessFn processFn = nullptr;
+
+	instrument::Probe probe{this};
 
 	BrownianBridge() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS);
@@ -46,13 +55,42 @@ struct BrownianBridge : Module {
 		configInput(TRIG_INPUT, "Reset to minimum trigger");
 
 		configOutput(SIG_OUTPUT, "Signal");
+		bridge.setSampleRate(APP->engine->getSampleRate());
+	}
+
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		seed.dataToJson(rootJ);
+		// where each bridge is and how far along it is
+		StateBlob state;
+		state.write(bridge.outsignal);
+		state.write(bridge.internaltime);
+		state.write(bridge.internalmaxtime);
+		state.write(bridge.arrived);
+		state.toJson(rootJ);
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		if (rootJ == nullptr)
+			return;
+		seed.dataFromJson(rootJ);
+		StateBlob state;
+		if (state.fromJson(rootJ, sizeof(bridge.outsignal) + sizeof(bridge.internaltime) + sizeof(bridge.internalmaxtime) + sizeof(bridge.arrived))) {
+			state.read(bridge.outsignal);
+			state.read(bridge.internaltime);
+			state.read(bridge.internalmaxtime);
+			state.read(bridge.arrived);
+		}
 	}
 
 	void onSampleRateChange() override {
-		sqrtdelta = 1.0/std::sqrt(APP->engine->getSampleRate());
+		bridge.setSampleRate(APP->engine->getSampleRate());
 	}
 
 	void process(const ProcessArgs& args) override {
+		instrument::Scope timer(probe);
+		seed.applyReseed();
 
 		int channels = std::max(inputs[TRIG_INPUT].getChannels(),
 			std::max(inputs[RANGE_INPUT].getChannels(),
@@ -60,41 +98,28 @@ struct BrownianBridge : Module {
 			std::max(inputs[NOISE_INPUT].getChannels(),
 			std::max(inputs[TIME_INPUT].getChannels(),
 			1)))));
-		for (int c = 0; c < channels; c++) {
-			float range = params[RANGE_PARAM].getValue() + inputs[RANGE_INPUT].getVoltage(c);
-			float offset = params[OFFSET_PARAM].getValue() + inputs[OFFSET_INPUT].getVoltage(c);
-			float noise = params[NOISE_PARAM].getValue() + inputs[NOISE_INPUT].getVoltage(c)/10.0f;
-			float timeParam = std::pow(2.0,params[TIME_PARAM].getValue()) + inputs[TIME_INPUT].getVoltage(c);
-		
-			if (inputTrigger[c].process(inputs[TRIG_INPUT].getVoltage(c)) || timeParam!=internalmaxtime[c]){
-				internaltime[c] = 0.f;
-				outsignal[c] = offset;
-				internalmaxtime[c] = timeParam;
-			}
-
-			float r = random::normal(); 
-			//float maxout = std:max(range+offset,offset);
-			//float minout = std:min(range+offset,offset);
-
-			internaltime[c] += args.sampleTime;
-			internaltime[c] = clamp(internaltime[c],0.0f,timeParam);
-			if(internaltime[c] < timeParam*0.999999f){
-				outsignal[c] += sqrtdelta*r*noise*range;
-				outsignal[c] += args.sampleTime*(range+offset-outsignal[c])/(timeParam - internaltime[c]);
-				// outsignal[c] = clamp(outsignal[c], offset, range+offset); 
-			}
-			else{
-				outsignal[c] = range+offset;
-			}
-			outputs[SIG_OUTPUT].setVoltage(outsignal[c],c);
+		uint32_t mask = connectedInputs(this, RANGE_INPUT, zcdsp::Bridge::NUM_CV);
+		if (mask != cvMask) {
+			cvMask = mask;
+			processFn = zcdsp::Bridge::variants()[mask];
 		}
+		uint32_t triggered = inputTrigger.process(inputs[TRIG_INPUT], channels);
+		zcdsp::Bridge::Controls k;
+		k.noise = params[NOISE_PARAM].getValue();
+		k.range = params[RANGE_PARAM].getValue();
+		k.offset = params[OFFSET_PARAM].getValue();
+		k.time = params[TIME_PARAM].getValue();
+		zcdsp::Bridge::CV cv;
+		cv.range = inputs[RANGE_INPUT].getVoltages();
+		cv.offset = inputs[OFFSET_INPUT].getVoltages();
+		cv.noise = inputs[NOISE_INPUT].getVoltages();
+		cv.time = inputs[TIME_INPUT].getVoltages();
+		(bridge.*processFn)(channels, k, cv, triggered, outputs[SIG_OUTPUT].getVoltages());
 		outputs[SIG_OUTPUT].setChannels(channels);
-        
 	}
 };
 
 
-
 struct BrownianBridgeWidget : ModuleWidget {
 	BrownianBridgeWidget(BrownianBridge* module) {
 		setModule(module);
@@ -122,6 +147,13 @@ struct BrownianBridgeWidget : ModuleWidget {
 
 
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		BrownianBridge *module = dynamic_cast<BrownianBridge*>(this->module);
+		menu->addChild(new MenuSeparator);
+		appendSeedMenu(menu, &module->seed);
+		appendProbeMenu(menu, &module->probe);
+	}
 };
 
 
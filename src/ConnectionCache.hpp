@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+
+// Which outputs have a cable, re-read once per block rather than per sample,
+// so process() can choose a path that skips math nobody listens to.
+// Everything counts as connected until the first check.
+struct ConnectionCache {
+	dsp::ClockDivider divider;
+	uint32_t mask = ~0u; // bit i set when output i is connected
+
+	ConnectionCache(uint32_t division = 64) {
+		divider.setDivision(division);
+	}
+
+	// True on the samples where the mask was refreshed, i.e. once per block.
+	bool process(Module* module) {
+		if (!divider.process())
+			return false;
+		uint32_t connected = 0;
+		for (size_t i = 0; i < module->outputs.size(); i++)
+			if (module->outputs[i].isConnected())
+				connected |= 1u << i;
+		mask = connected;
+		return true;
+	}
+
+	bool connected(int outputId) const {
+		return (mask >> outputId) & 1u;
+	}
+
+	bool any() const {
+		return mask != 0;
+	}
+
+	int blockSize() {
+		return divider.getDivision();
+	}
+};
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+
+// Runs control-rate work at a fixed rate in Hz, independent of the sample rate.
+// The work is split into slots (usually polyphony channels), and the slot
+// updates are spread evenly over the control period, so a module does a
+// little work on every sample instead of all of it on one. Each instance starts
+// at a random point in the period, so several instances don't update on the
+// same frame either.
+struct ControlScheduler {
+	float rate;
+	int period = 1;  // samples between two updates of the same slot
+	int counter = 0; // position in the period
+	int nextSlot = 0;
+
+	ControlScheduler(float rate = 400.f) : rate(rate) {
+		setSampleRate(APP->engine->getSampleRate());
+		counter = random::u32() % period;
+	}
+
+	void setSampleRate(float sampleRate) {
+		period = std::max((int) std::round(sampleRate/rate), 1);
+		counter %= period;
+	}
+
+	void setRate(float rate, float sampleRate) {
+		this->rate = rate;
+		setSampleRate(sampleRate);
+	}
+
+	// Calls update(slot) for each slot that is due this sample; every slot
+	// comes up once per period.
+	template <typename F>
+	void process(int slots, F update) {
+		// fewer slots than last time: the rest of this period has nothing due
+		if (nextSlot > slots)
+			nextSlot = slots;
+		// slot k is due from sample k*period/slots of the period on
+		while (nextSlot < slots && (int64_t) nextSlot*period <= (int64_t) counter*slots) {
+			update(nextSlot);
+			nextSlot++;
+		}
+		if (++counter >= period) {
+			counter = 0;
+			nextSlot = 0;
+		}
+	}
+};
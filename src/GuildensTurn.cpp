@@ -2,7 +2,14 @@
  * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
  */
 #include "plugin.hpp"
-#include <array>
+#include "MarkovStats.hpp"
+#include "TriggerBank.hpp"
+#include "MarkovBus.hpp"
+#include "dsp/RingChain.hpp"
+#include "SeedSetting.hpp"
+#include "Instrument.hpp"
+#include "Trace.hpp"
+#include "StateBlob.hpp"
 
 struct GuildensTurn : Module {
 
@@ -49,12 +56,21 @@ struct GuildensTurn : Module {
 		NUM_OUTPUTS
 	};
 
-    float state[16] = {1.f,1.f,1.f,1.f,1.f,1.f,1.f,1.f,1.f,1.f,1.f,1.f,1.f,1.f,1.f,1.f}; //1=A, 2=B, 3=C, 4=D
-    int indexs[4] = {A_INPUT,B_INPUT,C_INPUT,D_INPUT};
     int prob_inds[8] = {PAD_PARAM,PAB_PARAM,PBA_PARAM,PBC_PARAM,PCB_PARAM,PCD_PARAM,PDC_PARAM,PDA_PARAM};
     int att_inds[8] =  {aPAD_PARAM,aPAB_PARAM,aPBA_PARAM,aPBC_PARAM,aPCB_PARAM,aPCD_PARAM,aPDC_PARAM,aPDA_PARAM};
     int inprob_inds[8] = {PAD_INPUT,PAB_INPUT,PBA_INPUT,PBC_INPUT,PCB_INPUT,PCD_INPUT,PDC_INPUT,PDA_INPUT};
-	std::array<rack::dsp::SchmittTrigger,16> inputTrigger;
+	TriggerBank inputTrigger;
+    OccupancyStats<4> stats;
+    // STATE is only rewritten on transitions, or for every channel when the channel count or connection changes
+    int heldChannels = 0;
+    bool heldConnected = false;
+    MarkovBusMessage busMessages[2];
+    zcdsp::RingChain chain{random::u64()};
+    SeedSetting seed{&chain.rng};
+    int busMode = BUS_CLOCK;
+
+	instrument::Probe probe{this};
+	TraceRecorder trace{"GuildensTurn", {"state"}};
 
 	GuildensTurn() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS);
@@ -92,9 +108,72 @@ struct GuildensTurn : Module {
 
         configOutput(OUT_OUTPUT, "Routed signal");
         configOutput(STATE_OUTPUT, "Current state (A=1,B=2,C=3,D=4 volts)");
+
+        markovbus::attach(this, busMessages);
+        chain.setSampleRate(APP->engine->getSampleRate());
 	}
 
+    json_t *dataToJson() override {
+        json_t *rootJ = json_object();
+        json_object_set_new(rootJ, "busmode", json_integer(busMode));
+        json_object_set_new(rootJ, "sharedchain", json_boolean(chain.sharedChain));
+        json_object_set_new(rootJ, "continuoustime", json_boolean(chain.continuousTime));
+        json_object_set_new(rootJ, "ratescale", json_real(chain.rateScale));
+        seed.dataToJson(rootJ);
+        StateBlob blob;
+        blob.write(chain.state);
+        blob.toJson(rootJ);
+        return rootJ;
+    }
+
+    void dataFromJson(json_t *rootJ) override {
+        if (rootJ == nullptr)
+            return;
+        json_t *busmodej = json_object_get(rootJ, "busmode");
+        if (busmodej)
+            busMode = clamp((int) json_integer_value(busmodej), 0, NUM_BUS_MODES - 1);
+        json_t *sharedchainj = json_object_get(rootJ, "sharedchain");
+        if (sharedchainj)
+            chain.sharedChain = json_is_true(sharedchainj);
+        json_t *continuoustimej = json_object_get(rootJ, "continuoustime");
+        if (continuoustimej)
+            chain.continuousTime = json_is_true(continuoustimej);
+        json_t *ratescalej = json_object_get(rootJ, "ratescale");
+        if (ratescalej)
+            chain.rateScale = json_number_value(ratescalej);
+        seed.dataFromJson(rootJ);
+        StateBlob blob;
+        if (blob.fromJson(rootJ, sizeof(chain.state))) {
+            blob.read(chain.state);
+            for (int c = 0; c < 16; c++)
+                chain.setState(c, clamp((int) chain.state[c], 0, 3));
+            // rewrite STATE for every channel on the next sample
+            heldChannels = 0;
+        }
+        chain.armedChannels = 0;
+    }
+
+    // Knob plus attenuated CV for the backward and forward transitions out of state index (0 to 3), clamped to [0,1].
+    void controlValues(int c, int index, float& Pback, float& Pforward) {
+        Pback = params[prob_inds[index*2]].getValue() + params[att_inds[index*2]].getValue()*inputs[inprob_inds[index*2]].getVoltage(c);
+        Pforward = params[prob_inds[index*2+1]].getValue() + params[att_inds[index*2+1]].getValue()*inputs[inprob_inds[index*2+1]].getVoltage(c);
+        Pback = clamp(Pback,0.f,1.f);
+        Pforward = clamp(Pforward,0.f,1.f);
+    }
+
+    void transitionMatrix(int c, float P[4][4]) {
+        chain.transitionMatrix(c, P, [this](int c, int index, float& Pback, float& Pforward) {
+            controlValues(c, index, Pback, Pforward);
+        });
+    }
+
+    void onSampleRateChange() override {
+        chain.setSampleRate(APP->engine->getSampleRate());
+    }
+
 	void process(const ProcessArgs& args) override {
+		instrument::Scope timer(probe);
+		seed.applyReseed();
 
 		int channels = std::max(inputs[TRIG_INPUT].getChannels(),
         std::max(inputs[A_INPUT].getChannels(),
@@ -102,39 +181,104 @@ struct GuildensTurn : Module {
         std::max(inputs[C_INPUT].getChannels(),
         std::max(inputs[D_INPUT].getChannels(),
         1)))));
-        for (int c = 0; c < channels; c++) {
-            int index = (int) (round(state[c])-1); // 0 to 3
-            index = clamp(index,0,3);
-            if (inputTrigger[c].process(inputs[TRIG_INPUT].getVoltage(c))){
-
-                float Pback = params[prob_inds[index*2]].getValue() + params[att_inds[index*2]].getValue()*inputs[inprob_inds[index*2]].getVoltage(c);
-                float Pforward = params[prob_inds[index*2+1]].getValue() + params[att_inds[index*2+1]].getValue()*inputs[inprob_inds[index*2+1]].getVoltage(c);
-                Pback = clamp(Pback,0.f,1.f);
-                Pforward = clamp(Pforward,0.f,1.f);
-                float Pfb = std::max(Pback + Pforward,1.f);
-                Pback = Pback/Pfb;
-                Pforward = Pforward/Pfb;
-
-                float Tr = random::uniform(); 
-                if (Tr < Pforward){
-                    index += 1;
-                    if (index > 3){
-                        index = 0;     
-                    }
-                } else if (Tr < (Pforward+Pback)){
-                    index = index - 1;
-                    if (index < 0){
-                        index = 3;     
-                    }
-                } 
+        auto controls = [this](int c, int index, float& Pback, float& Pforward) {
+            controlValues(c, index, Pback, Pforward);
+        };
+        // with TRIG unpatched, a Rosenchance or GuildensTurn on the left drives the clock
+        const MarkovBusMessage* bus = (inputs[TRIG_INPUT].isConnected() || chain.continuousTime) ? nullptr : markovbus::receive(this, args.frame);
+        uint32_t triggered;
+        if (chain.continuousTime){
+            triggered = chain.expiredHolds(channels, controls);
+        } else if (bus){
+            channels = std::max(channels, bus->channels);
+            triggered = (busMode == BUS_TRANSITIONS) ? bus->transitions : bus->clock;
+            triggered &= (uint32_t) ((1ull << channels) - 1);
+        } else {
+            triggered = inputTrigger.process(inputs[TRIG_INPUT], channels);
+        }
+        bool mirror = bus && busMode == BUS_MIRROR;
+        uint32_t active = (uint32_t) ((1ull << channels) - 1);
+        uint32_t changed = 0;
+
+        if (triggered && chain.sharedChain){
+            // one draw, made with the first clocked channel's probabilities, moves every channel
+            int c0 = firstChannel(triggered);
+            int index = mirror ? clamp((int) bus->state[c0],0,3) : chain.continuousTime ? chain.nextIndex[c0] : chain.step(c0, chain.state[c0], controls);
+            for (int c = 0; c < channels; c++) {
+                if (chain.continuousTime)
+                    stats.countHold(c, chain.state[c], index, (uint32_t) (chain.sampleCount - chain.enteredAt[c0]));
+                else
+                    stats.count(c, chain.state[c], index);
+                if (chain.state[c] != index)
+                    changed |= 1u << c;
+                chain.setState(c, index);
+            }
+            if (chain.continuousTime){
+                chain.armHold(c0, controls);
+                chain.updateNextDeadline();
+            }
+            triggered = active;
+        }
+        else if (triggered) {
+            for (uint32_t m = triggered; m; m &= m - 1) {
+                int c = firstChannel(m);
+                int from = chain.state[c];
+                int index = mirror ? clamp((int) bus->state[c],0,3) : chain.continuousTime ? chain.nextIndex[c] : chain.step(c, from, controls);
+                if (chain.continuousTime)
+                    stats.countHold(c, from, index, (uint32_t) (chain.sampleCount - chain.enteredAt[c]));
+                else
+                    stats.count(c, from, index);
+                if (index != from)
+                    changed |= 1u << c;
+                chain.setState(c, index);
+                if (chain.continuousTime)
+                    chain.armHold(c, controls);
             }
-            state[c] = (float) index + 1.f;
-            outputs[STATE_OUTPUT].setVoltage(state[c],c);
-            int input_ind = indexs[index];
-            outputs[OUT_OUTPUT].setVoltage(inputs[input_ind].getVoltage(c),c);
+            if (chain.continuousTime)
+                chain.updateNextDeadline();
+        }
+
+        // STATE is held between transitions
+        uint32_t refresh = changed;
+        bool stateConnected = outputs[STATE_OUTPUT].isConnected();
+        if (channels != heldChannels || stateConnected != heldConnected){
+            refresh = active;
+            heldChannels = channels;
+            heldConnected = stateConnected;
+        }
+        for (uint32_t m = refresh; m; m &= m - 1) {
+            int c = firstChannel(m);
+            outputs[STATE_OUTPUT].setVoltage(chain.state[c] + 1.f,c);
+        }
+
+        // route A-D to OUT with masked selects, four channels at a time
+        for (int c = 0; c < channels; c += 4) {
+            simd::float_4 s = simd::float_4::load(&chain.stateLanes[c]);
+            simd::float_4 a = inputs[A_INPUT].getVoltageSimd<simd::float_4>(c);
+            simd::float_4 b = inputs[B_INPUT].getVoltageSimd<simd::float_4>(c);
+            simd::float_4 cc = inputs[C_INPUT].getVoltageSimd<simd::float_4>(c);
+            simd::float_4 d = inputs[D_INPUT].getVoltageSimd<simd::float_4>(c);
+            simd::float_4 out = simd::ifelse(s == 0.f, a, simd::ifelse(s == 1.f, b, simd::ifelse(s == 2.f, cc, d)));
+            outputs[OUT_OUTPUT].setVoltageSimd(out, c);
 	    }   
         outputs[STATE_OUTPUT].setChannels(channels);   
         outputs[OUT_OUTPUT].setChannels(channels);  
+        stats.channels = channels;
+
+        MarkovBusMessage* msg = markovbus::beginSend(this, args.frame);
+        if (msg){
+            msg->channels = channels;
+            msg->clock = triggered;
+            msg->transitions = changed;
+            for (int c = 0; c < channels; c++)
+                msg->state[c] = chain.state[c];
+            markovbus::endSend(this);
+        }
+        if (float* traced = trace.beginFrame(args.frame, channels)) {
+            for (int c = 0; c < channels; c++)
+                traced[c] = chain.state[c];
+            trace.endFrame();
+        }
     }
 };
 
@@ -191,6 +335,81 @@ struct GuildensTurnWidget : ModuleWidget {
 
 
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		GuildensTurn *module = dynamic_cast<GuildensTurn*>(this->module);
+		static const char* const stateNames[4] = {"A", "B", "C", "D"};
+
+		struct SharedChainMenuItem : MenuItem
+		{
+			GuildensTurn* module = nullptr;
+
+			void onAction(const event::Action &e) override
+			{
+				module->chain.sharedChain = !module->chain.sharedChain;
+			}
+		};
+
+		menu->addChild(new MenuSeparator);
+		SharedChainMenuItem *sharedItem = createMenuItem<SharedChainMenuItem>("Shared chain (one draw moves all channels)", CHECKMARK(module->chain.sharedChain));
+		sharedItem->module = module;
+		menu->addChild(sharedItem);
+
+		struct ContinuousTimeMenuItem : MenuItem
+		{
+			GuildensTurn* module = nullptr;
+
+			void onAction(const event::Action &e) override
+			{
+				module->chain.continuousTime = !module->chain.continuousTime;
+				module->chain.armedChannels = 0;
+				module->stats.reset();
+			}
+		};
+		struct RateScaleMenuItem : MenuItem
+		{
+			GuildensTurn* module = nullptr;
+			float rateScale = 10.f;
+
+			void onAction(const event::Action &e) override
+			{
+				module->chain.rateScale = rateScale;
+				module->chain.armedChannels = 0;
+			}
+		};
+
+		menu->addChild(new MenuSeparator);
+		ContinuousTimeMenuItem *continuousItem = createMenuItem<ContinuousTimeMenuItem>("Free-running (continuous time, ignores TRIG)", CHECKMARK(module->chain.continuousTime));
+		continuousItem->module = module;
+		menu->addChild(continuousItem);
+		menu->addChild(createMenuLabel("Transition rate at full knob"));
+		const float rateScales[] = {1.f, 10.f, 100.f};
+		for (float rateScale : rateScales) {
+			RateScaleMenuItem *rateItem = createMenuItem<RateScaleMenuItem>(string::f("%g Hz", rateScale), CHECKMARK(module->chain.rateScale == rateScale));
+			rateItem->module = module;
+			rateItem->rateScale = rateScale;
+			menu->addChild(rateItem);
+		}
+
+		menu->addChild(new MenuSeparator);
+		appendBusMenu(menu, &module->busMode);
+
+		menu->addChild(new MenuSeparator);
+		appendSeedMenu(menu, &module->seed);
+		if (module->chain.continuousTime) {
+			// per-sample matrix, so dwell times come out in samples and are shown in seconds
+			appendOccupancyMenu<4>(menu, &module->stats, stateNames, "s", [=](int c, float P[4][4]) {
+				module->transitionMatrix(c, P);
+			}, 1.f/module->chain.sampleRate);
+		} else {
+			appendOccupancyMenu<4>(menu, &module->stats, stateNames, "triggers", [=](int c, float P[4][4]) {
+				module->transitionMatrix(c, P);
+			});
+		}
+		menu->addChild(new MenuSeparator);
+		appendTraceMenu(menu, &module->trace);
+		appendProbeMenu(menu, &module->probe);
+	}
 };
 
 
@@ -3,6 +3,13 @@
  */
 #include "plugin.hpp"
 #include <array>
+#include "dsp/IOU.hpp"
+#include "SeedSetting.hpp"
+#include "ConnectionCache.hpp"
+#include "ProcessVariants.hpp"
+#include "Instrument.hpp"
+#include "Trace.hpp"
+#include "StateBlob.hpp"
 
 struct IOU : Module {
 
@@ -29,10 +36,15 @@ struct IOU : Module {
 		NUM_OUTPUTS
 	};
 
-	float outrands[16] = {0};
-    float outous[16] = {0};
-    float outious[16] = {0};
-	float sqrtdelta = 1.0/std::sqrt(APP->engine->getSampleRate());
+	zcdsp::IOUProcess iou{random::u64()};
+	SeedSetting seed{&iou.rng};
+	ConnectionCache connections;
+	// the full path runs the variant for the CV inputs patched, NOISE_INPUT..EXT_INPUT
+	uint32_t cvMask = ~0u;
+	zcdsp::IOUProcess::ProcessFn processFn = nullptr;
+
+	instrument::Probe probe{this};
+	TraceRecorder trace{"IOU", {"velocity", "position"}};
 
 	IOU() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS);
@@ -51,13 +63,67 @@ struct IOU : Module {
 		configOutput(RAND_OUTPUT, "White noise (mixed additively with external in)");
 		configOutput(OU_OUTPUT, "Ornstein-Uhlenbeck process signal");
         configOutput(IOU_OUTPUT, "Integrated (smoothed) Ornstein-Uhlenbeck signal");
+		iou.setSampleRate(APP->engine->getSampleRate());
+	}
+
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		seed.dataToJson(rootJ);
+		StateBlob state;
+		state.write(iou.outous);
+		state.write(iou.outious);
+		state.toJson(rootJ);
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		if (rootJ == nullptr)
+			return;
+		seed.dataFromJson(rootJ);
+		StateBlob state;
+		if (state.fromJson(rootJ, sizeof(iou.outous) + sizeof(iou.outious))) {
+			state.read(iou.outous);
+			state.read(iou.outious);
+		}
 	}
 
 	void onSampleRateChange() override {
-		sqrtdelta = 1.0/std::sqrt(APP->engine->getSampleRate());
+		iou.setSampleRate(APP->engine->getSampleRate());
+	}
+
+	zcdsp::IOUProcess::Controls controls() {
+		zcdsp::IOUProcess::Controls k;
+		k.noise = params[NOISE_PARAM].getValue();
+		k.spring = params[SPRING_PARAM].getValue();
+		k.damp = params[DAMP_PARAM].getValue();
+		k.mean = params[MEAN_PARAM].getValue();
+		k.mix = params[MIX_PARAM].getValue();
+		return k;
+	}
+
+	zcdsp::IOUProcess::CV cv() {
+		zcdsp::IOUProcess::CV cv;
+		cv.noise = inputs[NOISE_INPUT].getVoltages();
+		cv.spring = inputs[SPRING_INPUT].getVoltages();
+		cv.damp = inputs[DAMP_INPUT].getVoltages();
+		cv.mean = inputs[MEAN_INPUT].getVoltages();
+		cv.ext = inputs[EXT_INPUT].getVoltages();
+		return cv;
+	}
+
+	void traceState(int64_t sample, int channels) {
+		if (float* traced = trace.beginFrame(sample, channels)) {
+			for (int c = 0; c < channels; c++) {
+				traced[c*2] = iou.outous[c];
+				traced[c*2 + 1] = iou.outious[c];
+			}
+			trace.endFrame();
+		}
 	}
 
 	void process(const ProcessArgs& args) override {
+		instrument::Scope timer(probe);
+		seed.applyReseed();
 
 		int channels = std::max(inputs[SPRING_INPUT].getChannels(),
 			std::max(inputs[NOISE_INPUT].getChannels(),
@@ -66,34 +132,39 @@ struct IOU : Module {
 			std::max(inputs[EXT_INPUT].getChannels(),
 			1)))));
 
-		for (int c = 0; c < channels; c++) {
-			float noise = params[NOISE_PARAM].getValue() + inputs[NOISE_INPUT].getVoltage(c)/10.0f;
-			float spring = params[SPRING_PARAM].getValue() + inputs[SPRING_INPUT].getVoltage(c);
-			float mean = params[MEAN_PARAM].getValue() + inputs[MEAN_INPUT].getVoltage(c);
-			float damp = params[DAMP_PARAM].getValue() + inputs[DAMP_INPUT].getVoltage(c);
-            float mix = params[MIX_PARAM].getValue();
-            float ext = inputs[EXT_INPUT].getVoltage(c);
-
-
-			float r = random::normal(); 
-            outrands[c] = r*noise;
-            outious[c] += outous[c]*args.sampleTime;
-			outous[c] += sqrtdelta*outrands[c];
-			outous[c] += (-spring*outous[c] + damp*(mean - outious[c]))*args.sampleTime;
+		bool refreshed = connections.process(this);
+		zcdsp::IOUProcess::Controls k = controls();
+		// while OU and IOU are unpatched their state is only advanced once per block
+		if (!connections.connected(OU_OUTPUT) && !connections.connected(IOU_OUTPUT)) {
+			if (connections.connected(RAND_OUTPUT))
+				iou.processNoise(channels, k, cv(), outputs[RAND_OUTPUT].getVoltages());
+			iou.idleSamples++;
+			if (refreshed)
+				iou.catchUp(channels, k, cv());
+			outputs[RAND_OUTPUT].setChannels(channels);
+			outputs[OU_OUTPUT].setChannels(channels);
+			outputs[IOU_OUTPUT].setChannels(channels);
+			traceState(args.frame, channels);
+			return;
+		}
+		if (iou.idleSamples > 0)
+			iou.catchUp(channels, k, cv());
 
-			outputs[RAND_OUTPUT].setVoltage(outrands[c]*(1.0f-mix) + mix*ext,c);
-            outputs[OU_OUTPUT].setVoltage(outous[c]*(1.0f-mix) + mix*ext,c);
-            outputs[IOU_OUTPUT].setVoltage(outious[c]*(1.0f-mix) + mix*ext,c);
+		uint32_t mask = connectedInputs(this, NOISE_INPUT, zcdsp::IOUProcess::NUM_CV);
+		if (mask != cvMask) {
+			cvMask = mask;
+			processFn = zcdsp::IOUProcess::variants()[mask];
 		}
+		zcdsp::IOUProcess::Outputs out = {outputs[RAND_OUTPUT].getVoltages(), outputs[OU_OUTPUT].getVoltages(), outputs[IOU_OUTPUT].getVoltages()};
+		(iou.*processFn)(channels, k, cv(), out);
 		outputs[RAND_OUTPUT].setChannels(channels);
         outputs[OU_OUTPUT].setChannels(channels);
         outputs[IOU_OUTPUT].setChannels(channels);
-        
+		traceState(args.frame, channels);
 	}
 };
 
 
-
 struct IOUWidget : ModuleWidget {
 	float x1 = 8.4f;
 	float x2 = 22.4f;
@@ -122,6 +193,15 @@ struct IOUWidget : ModuleWidget {
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(x2, 42)), module, IOU::OU_OUTPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(x2, 61)), module, IOU::IOU_OUTPUT));
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		IOU *module = dynamic_cast<IOU*>(this->module);
+		menu->addChild(new MenuSeparator);
+		appendSeedMenu(menu, &module->seed);
+		menu->addChild(new MenuSeparator);
+		appendTraceMenu(menu, &module->trace);
+		appendProbeMenu(menu, &module->probe);
+	}
 };
 
 
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#include "Instrument.hpp"
+
+#ifdef ZC_INSTRUMENT
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace instrument {
+
+// Probes of the live modules, and the thread that writes them out. Only module
+// construction, destruction and the writer's copy of the probes take the lock.
+struct Registry {
+	std::mutex mutex;
+	std::vector<Probe*> probes;
+	std::thread writer;
+	std::condition_variable wake;
+	bool running = false;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	~Registry() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+		wake.notify_all();
+		if (writer.joinable())
+			writer.join();
+	}
+
+	void add(Probe* probe) {
+		std::lock_guard<std::mutex> lock(mutex);
+		probes.push_back(probe);
+		if (!running) {
+			running = true;
+			writer = std::thread([this]() { run(); });
+		}
+	}
+
+	void remove(Probe* probe) {
+		std::lock_guard<std::mutex> lock(mutex);
+		probes.erase(std::remove(probes.begin(), probes.end(), probe), probes.end());
+	}
+
+	// one probe's last window, copied out so the file is written unlocked
+	struct Row {
+		std::string slug;
+		long long id;
+		uint32_t windows;
+		float meanNs;
+		float p99Ns;
+		float maxNs;
+		uint32_t ticks;
+	};
+
+	void run() {
+		std::string path = asset::user("ZetaCarinae-instrument.csv");
+		std::vector<Row> rows;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (running) {
+			wake.wait_for(lock, std::chrono::seconds(2));
+			if (!running)
+				continue;
+			rows.clear();
+			for (Probe* probe : probes) {
+				uint32_t windows = probe->windows.load(std::memory_order_relaxed);
+				if (windows == 0)
+					continue;
+				rows.push_back({probe->module->model ? probe->module->model->slug : "", (long long) probe->module->id, windows,
+					probe->meanNs.load(std::memory_order_relaxed),
+					probe->p99Ns.load(std::memory_order_relaxed),
+					probe->maxWindowNs.load(std::memory_order_relaxed),
+					probe->windowTicks.load(std::memory_order_relaxed)});
+			}
+			if (rows.empty())
+				continue;
+			// module construction and destruction never wait on the disk
+			lock.unlock();
+			write(path, rows);
+			lock.lock();
+		}
+	}
+
+	void write(const std::string& path, const std::vector<Row>& rows) {
+		FILE* f = std::fopen(path.c_str(), "a");
+		if (!f)
+			return;
+		if (std::ftell(f) == 0)
+			std::fprintf(f, "seconds,module,id,windows,mean_ns,p99_ns,max_ns,ticks\n");
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		for (const Row& row : rows) {
+			std::fprintf(f, "%.1f,%s,%lld,%u,%.1f,%.1f,%.1f,%u\n", seconds, row.slug.c_str(), row.id,
+				row.windows, row.meanNs, row.p99Ns, row.maxNs, row.ticks);
+		}
+		std::fclose(f);
+	}
+};
+
+static Registry registry;
+
+Probe::Probe(Module* module) : module(module), windows(0), meanNs(0.f), p99Ns(0.f), maxWindowNs(0.f), windowTicks(0) {
+	registry.add(this);
+}
+
+Probe::~Probe() {
+	registry.remove(this);
+}
+
+void Probe::publish() {
+	uint32_t target = calls - calls/100;
+	uint32_t seen = 0;
+	int p99 = NUM_BUCKETS - 1;
+	for (int i = 0; i < NUM_BUCKETS; i++) {
+		seen += buckets[i];
+		if (seen >= target) {
+			p99 = i;
+			break;
+		}
+	}
+	meanNs.store((float) totalNs/calls, std::memory_order_relaxed);
+	p99Ns.store(bucketNs(p99 + 1), std::memory_order_relaxed);
+	maxWindowNs.store((float) maxNs, std::memory_order_relaxed);
+	windowTicks.store(ticks, std::memory_order_relaxed);
+	windows.fetch_add(1, std::memory_order_relaxed);
+	std::fill(buckets, buckets + NUM_BUCKETS, 0u);
+	calls = 0;
+	ticks = 0;
+	totalNs = 0;
+	maxNs = 0;
+}
+
+} // namespace instrument
+
+void appendProbeMenu(Menu* menu, instrument::Probe* probe) {
+	menu->addChild(new MenuSeparator);
+	if (probe->windows.load(std::memory_order_relaxed) == 0) {
+		menu->addChild(createMenuLabel("process(): collecting"));
+		return;
+	}
+	menu->addChild(createMenuLabel(string::f("process(): mean %.0f ns, p99 %.0f ns, max %.0f ns",
+		probe->meanNs.load(std::memory_order_relaxed),
+		probe->p99Ns.load(std::memory_order_relaxed),
+		probe->maxWindowNs.load(std::memory_order_relaxed))));
+	menu->addChild(createMenuLabel(string::f("Control ticks per %u calls: %u",
+		instrument::Probe::WINDOW, probe->windowTicks.load(std::memory_order_relaxed))));
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+#include <cstdint>
+
+// Optional timing of every process() call, for chasing dropouts that Rack's
+// averaged CPU meter hides. Build with ZC_INSTRUMENT defined (make
+// ZC_INSTRUMENT=1) to get it; otherwise every type below is empty and every
+// call compiles to nothing.
+//
+// Each module owns a Probe. The audio thread times process() into a log
+// histogram and, once per window of calls, publishes mean, p99 and max to
+// relaxed atomics; nothing on that path locks or allocates. The context menu
+// shows the last published window, and a background thread appends all
+// probes to ZetaCarinae-instrument.csv in the Rack user folder every couple
+// of seconds.
+#ifdef ZC_INSTRUMENT
+#include <atomic>
+#include <chrono>
+
+namespace instrument {
+
+struct Probe {
+	// 4 buckets per octave of ns, from 1 ns to ~4 s
+	static const int NUM_BUCKETS = 128;
+	static const uint32_t WINDOW = 1 << 15; // calls per published window
+
+	Module* module;
+	// audio thread only
+	uint32_t buckets[NUM_BUCKETS] = {};
+	uint32_t calls = 0;
+	uint32_t ticks = 0;
+	uint64_t totalNs = 0;
+	uint32_t maxNs = 0;
+	// last published window, read from any thread
+	std::atomic<uint32_t> windows;
+	std::atomic<float> meanNs;
+	std::atomic<float> p99Ns;
+	std::atomic<float> maxWindowNs;
+	std::atomic<uint32_t> windowTicks;
+
+	Probe(Module* module);
+	~Probe();
+
+	static int bucket(uint32_t ns) {
+		if (ns < 4)
+			return ns;
+		int octave = 31 - __builtin_clz(ns);
+		return octave*4 + ((ns >> (octave - 2)) & 3);
+	}
+
+	// lower edge of a bucket in ns
+	static float bucketNs(int index) {
+		if (index < 4)
+			return index;
+		int octave = index/4;
+		return std::ldexp(1.f + (index & 3)/4.f, octave);
+	}
+
+	void record(uint32_t ns) {
+		buckets[bucket(ns)]++;
+		totalNs += ns;
+		maxNs = std::max(maxNs, ns);
+		if (++calls >= WINDOW)
+			publish();
+	}
+
+	// a control-rate update ran this call
+	void tick() {
+		ticks++;
+	}
+
+	void publish();
+};
+
+// Times the enclosing scope, normally all of process().
+struct Scope {
+	Probe& probe;
+	std::chrono::steady_clock::time_point start;
+
+	Scope(Probe& probe) : probe(probe), start(std::chrono::steady_clock::now()) {}
+
+	~Scope() {
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		probe.record((uint32_t) std::min<int64_t>(ns, UINT32_MAX));
+	}
+};
+
+} // namespace instrument
+
+void appendProbeMenu(Menu* menu, instrument::Probe* probe);
+
+#else
+
+namespace instrument {
+
+struct Probe {
+	Probe(Module* module) {}
+	void tick() {}
+};
+
+struct Scope {
+	Scope(Probe& probe) {}
+};
+
+} // namespace instrument
+
+inline void appendProbeMenu(Menu* menu, instrument::Probe* probe) {}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+#include <cstdint>
+
+// Expander message passed from a Rosenchance or GuildensTurn to the module
+// directly on its right. Each module owns the two buffers for the messages it
+// receives from its left neighbour; Rack swaps producer and consumer at the end
+// of the frame, so the exchange needs no locks. A neighbour that stops sending
+// (bypassed, say) leaves its last message in place, so each message carries
+// the frame it was sent on and older ones are ignored.
+struct MarkovBusMessage {
+	int64_t frame = -1;
+	int channels = 0;
+	uint32_t clock = 0;       // channels that were clocked this frame
+	uint32_t transitions = 0; // channels whose state changed this frame
+	int8_t state[16] = {};    // current state of each channel, 0 = A
+};
+
+// How a module with nothing patched into TRIG follows its left neighbour.
+enum MarkovBusMode {
+	BUS_CLOCK,       // step whenever the left module is clocked
+	BUS_TRANSITIONS, // step only when the left module changes state
+	BUS_MIRROR,      // copy the left module's state on each of its clocks
+	NUM_BUS_MODES
+};
+
+namespace markovbus {
+
+inline bool isBusModule(Module* m) {
+	return m && (m->model == modelRosenchance || m->model == modelGuildensTurn);
+}
+
+inline void attach(Module* m, MarkovBusMessage* buffers) {
+	m->leftExpander.producerMessage = &buffers[0];
+	m->leftExpander.consumerMessage = &buffers[1];
+}
+
+// The message the left neighbour sent on the previous frame, or nullptr if it
+// is not part of the bus or sent nothing then.
+inline const MarkovBusMessage* receive(Module* m, int64_t frame) {
+	if (!isBusModule(m->leftExpander.module))
+		return nullptr;
+	const MarkovBusMessage* msg = (const MarkovBusMessage*) m->leftExpander.consumerMessage;
+	if (msg->frame + 1 < frame)
+		return nullptr;
+	return msg;
+}
+
+// The right neighbour's producer buffer to fill in this frame, or nullptr.
+inline MarkovBusMessage* beginSend(Module* m, int64_t frame) {
+	Module* right = m->rightExpander.module;
+	if (!isBusModule(right))
+		return nullptr;
+	MarkovBusMessage* msg = (MarkovBusMessage*) right->leftExpander.producerMessage;
+	msg->frame = frame;
+	return msg;
+}
+
+inline void endSend(Module* m) {
+	m->rightExpander.module->leftExpander.messageFlipRequested = true;
+}
+
+} // namespace markovbus
+
+// Context menu choice of how to follow the left neighbour.
+inline void appendBusMenu(Menu* menu, int* busMode) {
+	struct BusModeItem : MenuItem {
+		int* busMode = nullptr;
+		int mode = BUS_CLOCK;
+		void onAction(const event::Action& e) override {
+			*busMode = mode;
+		}
+	};
+	static const char* const labels[NUM_BUS_MODES] = {
+		"Step on its clock",
+		"Step on its state changes",
+		"Mirror its state",
+	};
+	menu->addChild(createMenuLabel("Chained to the module on the left (TRIG unpatched)"));
+	for (int mode = 0; mode < NUM_BUS_MODES; mode++) {
+		BusModeItem* item = createMenuItem<BusModeItem>(labels[mode], CHECKMARK(*busMode == mode));
+		item->busMode = busMode;
+		item->mode = mode;
+		menu->addChild(item);
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+#include <cmath>
+#include <cstdint>
+#include <functional>
+
+// Occupancy counters for an N state Markov chain, one set per polyphony channel.
+// The audio thread only does two integer increments per step; everything derived
+// from them (and the analytic values) is computed on the UI thread when the
+// context menu is opened.
+template <int N>
+struct OccupancyStats {
+	uint32_t steps[16][N];          // steps spent in each state
+	uint32_t transitions[16][N][N]; // counts of from -> to steps, including self transitions
+	int channels = 1;
+
+	OccupancyStats() {
+		reset();
+	}
+
+	void reset() {
+		for (int c = 0; c < 16; c++) {
+			for (int i = 0; i < N; i++) {
+				steps[c][i] = 0;
+				for (int j = 0; j < N; j++)
+					transitions[c][i][j] = 0;
+			}
+		}
+	}
+
+	void count(int c, int from, int to) {
+		steps[c][to]++;
+		transitions[c][from][to]++;
+	}
+
+	// For chains that jump at arbitrary times: the time spent in from is added on leaving it.
+	void countHold(int c, int from, int to, uint32_t duration) {
+		steps[c][from] += duration;
+		transitions[c][from][to]++;
+	}
+
+	// Fraction of steps spent in state s.
+	float occupancy(int c, int s) {
+		uint32_t total = 0;
+		for (int i = 0; i < N; i++)
+			total += steps[c][i];
+		return total > 0 ? (float) steps[c][s]/total : 0.f;
+	}
+
+	// Mean number of consecutive steps spent in state s per visit.
+	float dwell(int c, int s) {
+		uint32_t visits = 0;
+		for (int i = 0; i < N; i++)
+			if (i != s)
+				visits += transitions[c][i][s];
+		return visits > 0 ? (float) steps[c][s]/visits : 0.f;
+	}
+};
+
+// Solves pi P = pi, sum(pi) = 1 for a row-stochastic P by Gaussian elimination.
+// Returns false if the chain has no unique stationary distribution.
+template <int N>
+bool stationaryDistribution(const float P[N][N], float pi[N]) {
+	// transpose(P - I), with the last equation replaced by the normalisation
+	double A[N][N + 1];
+	for (int i = 0; i < N; i++) {
+		for (int j = 0; j < N; j++)
+			A[i][j] = P[j][i] - (i == j ? 1.0 : 0.0);
+		A[i][N] = 0.0;
+	}
+	for (int j = 0; j < N; j++)
+		A[N - 1][j] = 1.0;
+	A[N - 1][N] = 1.0;
+
+	for (int col = 0; col < N; col++) {
+		int pivot = col;
+		for (int row = col + 1; row < N; row++)
+			if (std::fabs(A[row][col]) > std::fabs(A[pivot][col]))
+				pivot = row;
+		if (std::fabs(A[pivot][col]) < 1e-9)
+			return false;
+		for (int j = 0; j <= N; j++)
+			std::swap(A[col][j], A[pivot][j]);
+		for (int row = 0; row < N; row++) {
+			if (row == col)
+				continue;
+			double f = A[row][col]/A[col][col];
+			for (int j = col; j <= N; j++)
+				A[row][j] -= f*A[col][j];
+		}
+	}
+	for (int i = 0; i < N; i++)
+		pi[i] = (float) (A[i][N]/A[i][i]);
+	return true;
+}
+
+// Adds an "Occupancy statistics" submenu comparing the analytic stationary distribution
+// and mean dwell times of the current transition matrix with the observed counts.
+// Dwell times are counted in steps and shown multiplied by scale, in the given unit.
+template <int N>
+void appendOccupancyMenu(Menu* menu, OccupancyStats<N>* stats, const char* const* stateNames, std::string unit,
+		std::function<void(int c, float P[N][N])> transitionMatrix, float scale = 1.f) {
+	menu->addChild(createSubmenuItem("Occupancy statistics", "", [=](Menu* menu) {
+		for (int c = 0; c < stats->channels; c++) {
+			menu->addChild(createSubmenuItem(string::f("Channel %d", c + 1), "", [=](Menu* menu) {
+				float P[N][N];
+				float pi[N];
+				transitionMatrix(c, P);
+				bool ergodic = stationaryDistribution<N>(P, pi);
+				for (int s = 0; s < N; s++) {
+					menu->addChild(createMenuLabel(string::f("State %s", stateNames[s])));
+					std::string analytic = ergodic ? string::f("%.3f", pi[s]) : "n/a";
+					menu->addChild(createMenuLabel(string::f("  stationary %s, observed %.3f",
+						analytic.c_str(), stats->occupancy(c, s))));
+					std::string dwell = P[s][s] < 1.f ? string::f("%.2f", scale/(1.f - P[s][s])) : "inf";
+					menu->addChild(createMenuLabel(string::f("  mean dwell %s %s, observed %.2f",
+						dwell.c_str(), unit.c_str(), scale*stats->dwell(c, s))));
+				}
+			}));
+		}
+		struct ResetItem : MenuItem {
+			OccupancyStats<N>* stats;
+			void onAction(const event::Action& e) override {
+				stats->reset();
+			}
+		};
+		ResetItem* resetItem = createMenuItem<ResetItem>("Reset statistics");
+		resetItem->stats = stats;
+		menu->addChild(resetItem);
+	}));
+}
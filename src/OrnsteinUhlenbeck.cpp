@@ -2,7 +2,13 @@
  * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
  */
 #include "plugin.hpp"
-#include <array>
+#include "TriggerBank.hpp"
+#include "dsp/OrnsteinUhlenbeck.hpp"
+#include "SeedSetting.hpp"
+#include "ConnectionCache.hpp"
+#include "ProcessVariants.hpp"
+#include "Instrument.hpp"
+#include "StateBlob.hpp"
 
 struct OrnsteinUhlenbeck : Module {
 
@@ -24,9 +30,15 @@ struct OrnsteinUhlenbeck : Module {
 		NUM_OUTPUTS
 	};
 
-	float outsignal[16] = {0};
-	std::array<rack::dsp::SchmittTrigger,16> inputTrigger;
-	float sqrtdelta = 1.0/std::sqrt(APP->engine->getSampleRate());
+	TriggerBank inputTrigger;
+	zcdsp::OUProcess ou{random::u64()};
+	SeedSetting seed{&ou.rng};
+	ConnectionCache connections;
+	// the active path runs the variant for the CV inputs patched, NOISE_INPUT..MEAN_INPUT
+	uint32_t cvMask = ~0u;
+	zcdsp::OUProcess::ProcessFn processFn = nullptr;
+
+	instrument::Probe probe{this};
 
 	OrnsteinUhlenbeck() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS);
@@ -40,13 +52,51 @@ struct OrnsteinUhlenbeck : Module {
 		configInput(TRIG_INPUT, "Trigger resets to mean");
 
 		configOutput(SIG_OUTPUT, "Ornstein-Uhlenbeck process signal");
+		ou.setSampleRate(APP->engine->getSampleRate());
+	}
+
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		seed.dataToJson(rootJ);
+		StateBlob state;
+		state.write(ou.outsignal);
+		state.toJson(rootJ);
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		if (rootJ == nullptr)
+			return;
+		seed.dataFromJson(rootJ);
+		StateBlob state;
+		if (state.fromJson(rootJ, sizeof(ou.outsignal)))
+			state.read(ou.outsignal);
+		ou.settled = 0;
 	}
 
 	void onSampleRateChange() override {
-		sqrtdelta = 1.0/std::sqrt(APP->engine->getSampleRate());
+		ou.setSampleRate(APP->engine->getSampleRate());
+	}
+
+	zcdsp::OUProcess::Controls controls() {
+		zcdsp::OUProcess::Controls k;
+		k.noise = params[NOISE_PARAM].getValue();
+		k.spring = params[SPRING_PARAM].getValue();
+		k.mean = params[MEAN_PARAM].getValue();
+		return k;
+	}
+
+	zcdsp::OUProcess::CV cv() {
+		zcdsp::OUProcess::CV cv;
+		cv.noise = inputs[NOISE_INPUT].getVoltages();
+		cv.spring = inputs[SPRING_INPUT].getVoltages();
+		cv.mean = inputs[MEAN_INPUT].getVoltages();
+		return cv;
 	}
 
 	void process(const ProcessArgs& args) override {
+		instrument::Scope timer(probe);
+		seed.applyReseed();
 
 		int channels = std::max(inputs[TRIG_INPUT].getChannels(),
 			std::max(inputs[NOISE_INPUT].getChannels(),
@@ -54,22 +104,35 @@ struct OrnsteinUhlenbeck : Module {
 			std::max(inputs[MEAN_INPUT].getChannels(),
 			1))));
 
-		for (int c = 0; c < channels; c++) {
-			float noise = params[NOISE_PARAM].getValue() + inputs[NOISE_INPUT].getVoltage(c)/10.0f;
-			float spring = params[SPRING_PARAM].getValue() + inputs[SPRING_INPUT].getVoltage(c);
-			float mean = params[MEAN_PARAM].getValue() + inputs[MEAN_INPUT].getVoltage(c);
-		
-			if (inputTrigger[c].process(inputs[TRIG_INPUT].getVoltage(c))){
-				outsignal[c] = mean;
-			}
-
-			float r = random::normal(); 
-			outsignal[c] += sqrtdelta*r*noise;
-			outsignal[c] += spring*(mean-outsignal[c])*args.sampleTime;
-			outputs[SIG_OUTPUT].setVoltage(outsignal[c],c);
+		uint32_t triggered = inputTrigger.process(inputs[TRIG_INPUT], channels);
+		bool refreshed = connections.process(this);
+		zcdsp::OUProcess::Controls k = controls();
+		// while SIG is unpatched the process is only advanced once per block
+		if (!connections.any()) {
+			ou.idle(triggered);
+			if (refreshed)
+				ou.catchUp(channels, k, cv());
+			outputs[SIG_OUTPUT].setChannels(channels);
+			return;
+		}
+		if (ou.idleSamples > 0)
+			ou.catchUp(channels, k, cv());
+
+		uint32_t mask = connectedInputs(this, NOISE_INPUT, zcdsp::OUProcess::NUM_CV);
+		if (mask != cvMask) {
+			cvMask = mask;
+			processFn = zcdsp::OUProcess::variants()[mask];
+			ou.settled = 0;
 		}
+		// A settled channel stays put until a knob or a trigger changes its step.
+		if (ou.holding(channels, k, triggered)) {
+			for (int c = 0; c < channels; c++)
+				outputs[SIG_OUTPUT].setVoltage(ou.outsignal[c],c);
+			outputs[SIG_OUTPUT].setChannels(channels);
+			return;
+		}
+		(ou.*processFn)(channels, k, cv(), triggered, outputs[SIG_OUTPUT].getVoltages());
 		outputs[SIG_OUTPUT].setChannels(channels);
-        
 	}
 };
 
@@ -99,6 +162,13 @@ struct OrnsteinUhlenbeckWidget : ModuleWidget {
 
 
 	}
+
+	void appendContextMenu(Menu *menu) override {
+		OrnsteinUhlenbeck *module = dynamic_cast<OrnsteinUhlenbeck*>(this->module);
+		menu->addChild(new MenuSeparator);
+		appendSeedMenu(menu, &module->seed);
+		appendProbeMenu(menu, &module->probe);
+	}
 };
 
 
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+
+// Smoothed copies of a module's first N params. Each knob is read once per
+// block and the value handed to the DSP ramps linearly to it over the block,
+// so a jump in a knob doesn't step the output. While no knob moves, process()
+// is one counter decrement. The first block takes the values as they are, so
+// params set before the module first runs (patch load, presets) don't ramp.
+template <int N>
+struct ParamRamps {
+	float value[N] = {};
+	float target[N] = {};
+	float step[N] = {};
+	int blockSize = 32;
+	int remaining = 0;
+	bool moving = false;
+	bool primed = false;
+
+	void process(Module* module) {
+		if (remaining > 0) {
+			remaining--;
+			if (moving)
+				for (int i = 0; i < N; i++)
+					value[i] += step[i];
+			return;
+		}
+		refresh(module);
+	}
+
+	float get(int paramId) const {
+		return value[paramId];
+	}
+
+private:
+	void refresh(Module* module) {
+		moving = false;
+		for (int i = 0; i < N; i++) {
+			// land exactly on the last target, whatever rounding did on the way
+			value[i] = target[i];
+			target[i] = module->params[i].getValue();
+			if (!primed)
+				value[i] = target[i];
+			step[i] = (target[i] - value[i])/blockSize;
+			if (step[i] != 0.f) {
+				moving = true;
+				value[i] += step[i];
+			}
+		}
+		primed = true;
+		remaining = blockSize - 1;
+	}
+};
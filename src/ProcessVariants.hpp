@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+#include "dsp/Variants.hpp"
+#include <cstdint>
+
+// Bit i set when input first + i has a cable. Modules pass the run of CV
+// inputs their process variants are specialised on.
+inline uint32_t connectedInputs(Module* module, int first, int count) {
+	uint32_t mask = 0;
+	for (int i = 0; i < count; i++)
+		if (module->inputs[first + i].isConnected())
+			mask |= 1u << i;
+	return mask;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+#include <chrono>
+
+// Opt-in CPU budget for the heavy oscillators. While enabled, the module's own
+// process() time is sampled (one call in SAMPLE_EVERY, as reading the clock
+// costs about as much as a light module's whole call), averaged over windows
+// and compared with a share of the sample period. Over budget, the quality
+// level steps down (level goes up) a window later; it only steps back up after
+// several windows well under budget, so it doesn't flap at the edge. What each
+// level gives up is the module's business; level 0 is always full quality.
+//
+// For offline renders, a "qualitylevel" key in the module's data pins the
+// level with the governor off; patches never save it.
+struct QualityGovernor {
+	static const int MAX_LEVEL = 3;
+	static const uint32_t SAMPLE_EVERY = 16;
+	static const uint32_t WINDOW = 128;  // timed calls per measurement
+	static const int QUIET_WINDOWS = 8;  // windows under half budget before stepping back up
+
+	bool enabled = false;
+	float budget = 0.05f; // share of a sample period
+	int level = 0;
+	// audio thread only
+	uint32_t skipped = 0;
+	uint32_t calls = 0;
+	int64_t totalNs = 0;
+	int quietWindows = 0;
+
+	// Ends a window: moves the level if the mean call time asks for it.
+	void endWindow(float sampleRate) {
+		float meanNs = (float) totalNs/calls;
+		float budgetNs = budget*1e9f/sampleRate;
+		calls = 0;
+		totalNs = 0;
+		if (meanNs > budgetNs) {
+			quietWindows = 0;
+			level = std::min(level + 1, MAX_LEVEL);
+		} else if (meanNs < 0.5f*budgetNs && level > 0) {
+			if (++quietWindows >= QUIET_WINDOWS) {
+				quietWindows = 0;
+				level--;
+			}
+		} else {
+			quietWindows = 0;
+		}
+	}
+
+	void record(int64_t ns, float sampleRate) {
+		totalNs += ns;
+		if (++calls >= WINDOW)
+			endWindow(sampleRate);
+	}
+
+	void setEnabled(bool enabled) {
+		this->enabled = enabled;
+		level = 0;
+		skipped = 0;
+		calls = 0;
+		totalNs = 0;
+		quietWindows = 0;
+	}
+
+	// green at full quality, red at the lowest, off while disabled
+	void setLight(Light* light) {
+		float degraded = enabled ? (float) level/MAX_LEVEL : 0.f;
+		light[0].setBrightness(enabled ? 1.f - degraded : 0.f);
+		light[1].setBrightness(degraded);
+	}
+
+	void dataToJson(json_t* rootJ) {
+		json_object_set_new(rootJ, "governor", json_boolean(enabled));
+		json_object_set_new(rootJ, "budget", json_real(budget));
+	}
+
+	void dataFromJson(json_t* rootJ) {
+		json_t* governorJ = json_object_get(rootJ, "governor");
+		if (governorJ)
+			setEnabled(json_is_true(governorJ));
+		json_t* budgetJ = json_object_get(rootJ, "budget");
+		// the menu's range; at zero or below it would sit at the lowest quality
+		if (budgetJ)
+			budget = clamp((float) json_number_value(budgetJ), 0.01f, 0.2f);
+		json_t* levelJ = json_object_get(rootJ, "qualitylevel");
+		if (levelJ)
+			forceLevel(json_integer_value(levelJ));
+	}
+
+	// Holds the given level, with the governor off, until it is enabled again.
+	void forceLevel(int level) {
+		setEnabled(false);
+		this->level = clamp(level, 0, MAX_LEVEL);
+	}
+
+	// true when this call is one of the timed ones
+	bool sample() {
+		if (!enabled || ++skipped < SAMPLE_EVERY)
+			return false;
+		skipped = 0;
+		return true;
+	}
+
+	// Times the enclosing scope, normally all of process(), when the governor samples this call.
+	struct Scope {
+		QualityGovernor& governor;
+		float sampleRate;
+		bool timed;
+		std::chrono::steady_clock::time_point start;
+
+		Scope(QualityGovernor& governor, float sampleRate) : governor(governor), sampleRate(sampleRate), timed(governor.sample()) {
+			if (timed)
+				start = std::chrono::steady_clock::now();
+		}
+
+		~Scope() {
+			if (!timed)
+				return;
+			auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			governor.record(ns, sampleRate);
+		}
+	};
+};
+
+// Context menu toggle for the governor, the budget choices and the current level.
+inline void appendGovernorMenu(Menu* menu, QualityGovernor* governor) {
+	struct EnableItem : MenuItem {
+		QualityGovernor* governor = nullptr;
+		void onAction(const event::Action& e) override {
+			governor->setEnabled(!governor->enabled);
+		}
+	};
+	struct BudgetItem : MenuItem {
+		QualityGovernor* governor = nullptr;
+		float budget = 0.05f;
+		void onAction(const event::Action& e) override {
+			governor->budget = budget;
+		}
+	};
+	EnableItem* enableItem = createMenuItem<EnableItem>("Reduce quality to fit a CPU budget", CHECKMARK(governor->enabled));
+	enableItem->governor = governor;
+	menu->addChild(enableItem);
+	if (!governor->enabled)
+		return;
+	menu->addChild(createMenuLabel("Budget (share of a sample period)"));
+	const float budgets[] = {0.01f, 0.02f, 0.05f, 0.1f, 0.2f};
+	for (float budget : budgets) {
+		BudgetItem* budgetItem = createMenuItem<BudgetItem>(string::f("%g%%", budget*100.f), CHECKMARK(governor->budget == budget));
+		budgetItem->governor = governor;
+		budgetItem->budget = budget;
+		menu->addChild(budgetItem);
+	}
+	menu->addChild(createMenuLabel(string::f("Quality level %d of %d", QualityGovernor::MAX_LEVEL - governor->level, QualityGovernor::MAX_LEVEL)));
+}
@@ -2,7 +2,15 @@
  * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
  */
 #include "plugin.hpp"
-#include <array>
+#include "MarkovStats.hpp"
+#include "TriggerBank.hpp"
+#include "MarkovBus.hpp"
+#include "dsp/HiddenMarkov.hpp"
+#include "SeedSetting.hpp"
+#include "Instrument.hpp"
+#include "Trace.hpp"
+#include "StateBlob.hpp"
+#include <atomic>
 
 struct Rosenchance : Module {
 
@@ -37,6 +45,7 @@ struct Rosenchance : Module {
         PBE1_INPUT,
         BE1_INPUT,
         BE2_INPUT,
+        EMISSION_INPUT,
 		NUM_INPUTS
 	};
 	enum OutputIds {
@@ -47,9 +56,26 @@ struct Rosenchance : Module {
 		NUM_OUTPUTS
 	};
 
-    float state[16] = {1.f}; //1=A, 2=B
-    int counter = 0;
-	std::array<rack::dsp::SchmittTrigger,16> inputTrigger;
+	TriggerBank inputTrigger;
+    // A/B entry triggers stay high for pulseLength samples
+    static const int pulseLength = 11;
+    int pulseRemaining[16] = {0};
+    uint32_t pulseMask = 0;
+    MarkovBusMessage busMessages[2];
+    zcdsp::HiddenMarkov hmm{random::u64()};
+    SeedSetting seed{&hmm.rng};
+    int busMode = BUS_CLOCK;
+    OccupancyStats<2> stats;
+
+    // Decoder mode: the emission input is observed on each trigger and the hidden state is inferred.
+    // The context menu only requests a change; process() makes it and resets the decoder, so the
+    // decoder is never reset under a step in progress.
+    bool decodeMode = false;
+    std::atomic<bool> requestedDecodeMode{false};
+    std::atomic<bool> decodeModePending{false};
+
+	instrument::Probe probe{this};
+	TraceRecorder trace{"Rosenchance", {"state"}};
 
 	Rosenchance() {
 		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS);
@@ -81,69 +107,196 @@ struct Rosenchance : Module {
         configInput(PBE1_INPUT, "Modulation of state B's e1 emission probability");
         configInput(BE1_INPUT, "Modulation of state B's  e1 emission value");
         configInput(BE2_INPUT, "Modulation of state B's  e2 emission value");
+        configInput(EMISSION_INPUT, "Observed emission (decoder mode)");
 
         configOutput(OUT_OUTPUT, "Emission value");
         configOutput(STATE_OUTPUT, "Current state (A=1, B=2 Volts)");
         configOutput(A_OUTPUT, "Triggers when entering state A");
         configOutput(B_OUTPUT, "Triggers when entering state B");
+
+        markovbus::attach(this, busMessages);
 	}
 
+    json_t *dataToJson() override {
+        json_t *rootJ = json_object();
+        json_object_set_new(rootJ, "decodemode", json_boolean(decodeMode));
+        json_object_set_new(rootJ, "viterbilag", json_integer(hmm.viterbiLag));
+        json_object_set_new(rootJ, "emissionwidth", json_real(hmm.emissionWidth));
+        json_object_set_new(rootJ, "busmode", json_integer(busMode));
+        seed.dataToJson(rootJ);
+        StateBlob blob;
+        blob.write(hmm.state);
+        blob.toJson(rootJ);
+        return rootJ;
+    }
+
+    void dataFromJson(json_t *rootJ) override {
+        if (rootJ == nullptr)
+            return;
+        json_t *decodemodej = json_object_get(rootJ, "decodemode");
+        if (decodemodej)
+            decodeMode = json_is_true(decodemodej);
+        decodeModePending.store(false);
+        json_t *viterbilagj = json_object_get(rootJ, "viterbilag");
+        if (viterbilagj)
+            hmm.viterbiLag = clamp((int) json_integer_value(viterbilagj), 0, zcdsp::HiddenMarkov::maxLag);
+        json_t *emissionwidthj = json_object_get(rootJ, "emissionwidth");
+        if (emissionwidthj)
+            hmm.emissionWidth = clamp((float) json_number_value(emissionwidthj), 0.01f, 2.f);
+        json_t *busmodej = json_object_get(rootJ, "busmode");
+        if (busmodej)
+            busMode = clamp((int) json_integer_value(busmodej), 0, NUM_BUS_MODES - 1);
+        seed.dataFromJson(rootJ);
+        StateBlob blob;
+        if (blob.fromJson(rootJ, sizeof(hmm.state))) {
+            blob.read(hmm.state);
+            for (int c = 0; c < 16; c++)
+                hmm.state[c] = (round(hmm.state[c]) == 2) ? 2.f : 1.f;
+        }
+        hmm.resetDecoder();
+    }
+
+    zcdsp::HiddenMarkov::Params getParams(int c) {
+        zcdsp::HiddenMarkov::Params p;
+        p.PA = params[PA_PARAM].getValue() + params[aPA_PARAM].getValue()*inputs[PA_INPUT].getVoltage(c);
+        p.PB = params[PB_PARAM].getValue() + params[aPB_PARAM].getValue()*inputs[PB_INPUT].getVoltage(c);
+        p.PAE1 = params[PAE1_PARAM].getValue() + params[aPAE1_PARAM].getValue()*inputs[PAE1_INPUT].getVoltage(c);
+        p.PBE1 = params[PBE1_PARAM].getValue() + params[aPBE1_PARAM].getValue()*inputs[PBE1_INPUT].getVoltage(c);
+        p.AE1 = params[AE1_PARAM].getValue() + params[aAE1_PARAM].getValue()*inputs[AE1_INPUT].getVoltage(c);
+        p.BE1 = params[BE1_PARAM].getValue() + params[aBE1_PARAM].getValue()*inputs[BE1_INPUT].getVoltage(c);
+        p.AE2 = params[AE2_PARAM].getValue() + params[aAE2_PARAM].getValue()*inputs[AE2_INPUT].getVoltage(c);
+        p.BE2 = params[BE2_PARAM].getValue() + params[aBE2_PARAM].getValue()*inputs[BE2_INPUT].getVoltage(c);
+        return p;
+    }
+
+    void transitionMatrix(int c, float P[2][2]) {
+        zcdsp::HiddenMarkov::transitionMatrix(getParams(c), P);
+    }
+
+    void decodeStep(int c, float v) {
+        float delayed = hmm.decodeStep(c, getParams(c), v);
+        outputs[STATE_OUTPUT].setVoltage(hmm.state[c],c);
+        outputs[OUT_OUTPUT].setVoltage(delayed,c);
+        outputs[A_OUTPUT].setVoltage(10.f*hmm.alpha[c][0],c);
+        outputs[B_OUTPUT].setVoltage(10.f*hmm.alpha[c][1],c);
+    }
+
+    // Channels to step this sample: from TRIG, or from the module on the left when TRIG is unpatched.
+    uint32_t clockMask(int64_t frame, int& channels, const MarkovBusMessage*& bus) {
+        bus = inputs[TRIG_INPUT].isConnected() ? nullptr : markovbus::receive(this, frame);
+        if (!bus)
+            return inputTrigger.process(inputs[TRIG_INPUT], channels);
+        channels = std::max(channels, bus->channels);
+        uint32_t triggered = (busMode == BUS_TRANSITIONS) ? bus->transitions : bus->clock;
+        return triggered & (uint32_t) ((1ull << channels) - 1);
+    }
+
+    void publish(int64_t frame, int channels, uint32_t triggered, uint32_t changed) {
+        MarkovBusMessage* msg = markovbus::beginSend(this, frame);
+        if (!msg)
+            return;
+        msg->channels = channels;
+        msg->clock = triggered;
+        msg->transitions = changed;
+        for (int c = 0; c < channels; c++)
+            msg->state[c] = (int8_t) (round(hmm.state[c]) == 2 ? 1 : 0);
+        markovbus::endSend(this);
+    }
+
+    void traceState(int64_t sample, int channels) {
+        if (float* traced = trace.beginFrame(sample, channels)) {
+            for (int c = 0; c < channels; c++)
+                traced[c] = hmm.state[c];
+            trace.endFrame();
+        }
+    }
+
+    int decode(int64_t frame) {
+        int channels = std::max(inputs[TRIG_INPUT].getChannels(),
+            std::max(inputs[EMISSION_INPUT].getChannels(),1));
+        const MarkovBusMessage* bus;
+        uint32_t triggered = clockMask(frame, channels, bus);
+        uint32_t changed = 0;
+        for (uint32_t m = triggered; m; m &= m - 1) {
+            int c = firstChannel(m);
+            float previous = hmm.state[c];
+            decodeStep(c, inputs[EMISSION_INPUT].getPolyVoltage(c));
+            if (hmm.state[c] != previous)
+                changed |= 1u << c;
+        }
+        outputs[STATE_OUTPUT].setChannels(channels);
+        outputs[OUT_OUTPUT].setChannels(channels);
+        outputs[A_OUTPUT].setChannels(channels);
+        outputs[B_OUTPUT].setChannels(channels);
+        publish(frame, channels, triggered, changed);
+        return channels;
+    }
+
+    // Draws the next state and emission for channel c; a forced state (0=A, 1=B) replaces the transition draw.
+    void generateStep(int c, int forced = -1) {
+        int from = (round(hmm.state[c])==1) ? 0 : 1;
+        float emission = hmm.generateStep(c, getParams(c), forced);
+        if (hmm.state[c] == 1.f){ // now in state A
+            stats.count(c, from, 0);
+            outputs[STATE_OUTPUT].setVoltage(1.0f,c);
+            outputs[A_OUTPUT].setVoltage(5.0f,c);
+            outputs[B_OUTPUT].setVoltage(0.f,c);
+        }
+        else{ // state is B
+            stats.count(c, from, 1);
+            outputs[STATE_OUTPUT].setVoltage(2.0f,c);
+            outputs[A_OUTPUT].setVoltage(0.f,c);
+            outputs[B_OUTPUT].setVoltage(5.f,c);
+        }
+        outputs[OUT_OUTPUT].setVoltage(emission,c);
+        pulseRemaining[c] = pulseLength;
+        pulseMask |= 1u << c;
+    }
+
 	void process(const ProcessArgs& args) override {
+		instrument::Scope timer(probe);
+		seed.applyReseed();
+
+        if (decodeModePending.load(std::memory_order_acquire)) {
+            decodeModePending.store(false, std::memory_order_relaxed);
+            decodeMode = requestedDecodeMode.load(std::memory_order_relaxed);
+            hmm.resetDecoder();
+        }
+        if (decodeMode){
+            traceState(args.frame, decode(args.frame));
+            return;
+        }
 
 		int channels = std::max(inputs[TRIG_INPUT].getChannels(),1);
-        for (int c = 0; c < channels; c++) {
-            if (inputTrigger[c].process(inputs[TRIG_INPUT].getVoltage(c))){
-                float PA = params[PA_PARAM].getValue() + params[aPA_PARAM].getValue()*inputs[PA_INPUT].getVoltage(c);
-                float PB = params[PB_PARAM].getValue() + params[aPB_PARAM].getValue()*inputs[PB_INPUT].getVoltage(c);
-                float PAE1 = params[PAE1_PARAM].getValue() + params[aPAE1_PARAM].getValue()*inputs[PAE1_INPUT].getVoltage(c);
-                float PBE1 = params[PBE1_PARAM].getValue() + params[aPBE1_PARAM].getValue()*inputs[PBE1_INPUT].getVoltage(c);
-                float AE1 = params[AE1_PARAM].getValue() + params[aAE1_PARAM].getValue()*inputs[AE1_INPUT].getVoltage(c);
-                float BE1 = params[BE1_PARAM].getValue() + params[aBE1_PARAM].getValue()*inputs[BE1_INPUT].getVoltage(c);
-                float AE2 = params[AE2_PARAM].getValue() + params[aAE2_PARAM].getValue()*inputs[AE2_INPUT].getVoltage(c);
-                float BE2 = params[BE2_PARAM].getValue() + params[aBE2_PARAM].getValue()*inputs[BE2_INPUT].getVoltage(c);
-               
-                float Tr = random::uniform(); 
-                float Er = random::uniform(); 
-                if ((round(state[c])==1 && Tr < PA) || (round(state[c])==2 && Tr > PB)){ // now in state A
-                    state[c] = 1.f;
-                    outputs[STATE_OUTPUT].setVoltage(1.0f,c);
-                    outputs[A_OUTPUT].setVoltage(5.0f,c);
-                    outputs[B_OUTPUT].setVoltage(0.f,c);
-                    
-                    if (Er < PAE1){
-                        outputs[OUT_OUTPUT].setVoltage(AE1,c);
-                    }
-                    else{
-                        outputs[OUT_OUTPUT].setVoltage(AE2,c);
-                    }
-                }
-                else{ // state is B
-                    state[c] = 2.f;
-                    outputs[STATE_OUTPUT].setVoltage(2.0f,c);
-                    outputs[A_OUTPUT].setVoltage(0.f,c);
-                    outputs[B_OUTPUT].setVoltage(5.f,c);
-                    if (Er < PBE1){
-                        outputs[OUT_OUTPUT].setVoltage(BE1,c);
-                    }
-                    else{
-                        outputs[OUT_OUTPUT].setVoltage(BE2,c);
-                    }
-                }
-            
-            }
-            else{
-                counter += 1;
-                if (counter > 10){
-                    counter = 0;
-                    outputs[A_OUTPUT].setVoltage(0.f,c);
-                    outputs[B_OUTPUT].setVoltage(0.f,c);
-                }
+        const MarkovBusMessage* bus;
+        uint32_t triggered = clockMask(args.frame, channels, bus);
+        uint32_t changed = 0;
+        for (uint32_t m = triggered; m; m &= m - 1) {
+            int c = firstChannel(m);
+            float previous = hmm.state[c];
+            if (bus && busMode == BUS_MIRROR)
+                generateStep(c, clamp((int) bus->state[c], 0, 1));
+            else
+                generateStep(c);
+            if (hmm.state[c] != previous)
+                changed |= 1u << c;
+        }
+        // only channels with an entry trigger still high need attention between events
+        for (uint32_t m = pulseMask & ~triggered; m; m &= m - 1) {
+            int c = firstChannel(m);
+            if (--pulseRemaining[c] <= 0){
+                outputs[A_OUTPUT].setVoltage(0.f,c);
+                outputs[B_OUTPUT].setVoltage(0.f,c);
+                pulseMask &= ~(1u << c);
             }
         }
 		outputs[STATE_OUTPUT].setChannels(channels);   
         outputs[OUT_OUTPUT].setChannels(channels);  
         outputs[A_OUTPUT].setChannels(channels);  
         outputs[B_OUTPUT].setChannels(channels); 
+        stats.channels = channels;
+        publish(args.frame, channels, triggered, changed);
+        traceState(args.frame, channels);
 	}
 };
 
@@ -186,15 +339,87 @@ struct RosenchanceWidget : ModuleWidget {
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(25, 81)), module, Rosenchance::BE1_INPUT));
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(25, 92)), module, Rosenchance::BE2_INPUT));
 
-		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(12.5, 102)), module, Rosenchance::TRIG_INPUT));
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(6, 102)), module, Rosenchance::TRIG_INPUT));
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(25, 102)), module, Rosenchance::EMISSION_INPUT));
 
-		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(12.5, 111)), module, Rosenchance::OUT_OUTPUT));
-		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(23, 111)), module, Rosenchance::STATE_OUTPUT));
+		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(6, 111)), module, Rosenchance::OUT_OUTPUT));
+		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(25, 111)), module, Rosenchance::STATE_OUTPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(6, 120)), module, Rosenchance::A_OUTPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(25, 120)), module, Rosenchance::B_OUTPUT));
 
+	}
+
+	void appendContextMenu(Menu *menu) override {
+		Rosenchance *module = dynamic_cast<Rosenchance*>(this->module);
+
+		struct DecodeMenuItem : MenuItem
+		{
+			Rosenchance* module = nullptr;
+
+			void onAction(const event::Action &e) override
+			{
+				module->requestedDecodeMode.store(!module->decodeMode, std::memory_order_relaxed);
+				module->decodeModePending.store(true, std::memory_order_release);
+			}
+		};
+		struct LagMenuItem : MenuItem
+		{
+			Rosenchance* module = nullptr;
+			int lag = 0;
+
+			void onAction(const event::Action &e) override
+			{
+				module->hmm.viterbiLag = lag;
+			}
+		};
+		struct WidthMenuItem : MenuItem
+		{
+			Rosenchance* module = nullptr;
+			float width = 0.1f;
+
+			void onAction(const event::Action &e) override
+			{
+				module->hmm.emissionWidth = width;
+			}
+		};
+
+		menu->addChild(new MenuSeparator);
+		DecodeMenuItem *decodeItem = createMenuItem<DecodeMenuItem>("Decoder mode (infer state from EMISSION input)", CHECKMARK(module->decodeMode));
+		decodeItem->module = module;
+		menu->addChild(decodeItem);
+
+		menu->addChild(createMenuLabel("Viterbi lag (triggers)"));
+		const int lags[] = {0, 1, 2, 4, 8, 16};
+		for (int lag : lags) {
+			LagMenuItem *lagItem = createMenuItem<LagMenuItem>(string::f("%d", lag), CHECKMARK(module->hmm.viterbiLag == lag));
+			lagItem->module = module;
+			lagItem->lag = lag;
+			menu->addChild(lagItem);
+		}
+
+		menu->addChild(createMenuLabel("Emission match width (V)"));
+		const float widths[] = {0.02f, 0.05f, 0.1f, 0.2f, 0.5f, 1.f};
+		for (float width : widths) {
+			WidthMenuItem *widthItem = createMenuItem<WidthMenuItem>(string::f("%g", width), CHECKMARK(module->hmm.emissionWidth == width));
+			widthItem->module = module;
+			widthItem->width = width;
+			menu->addChild(widthItem);
+		}
+
+		menu->addChild(new MenuSeparator);
+		appendBusMenu(menu, &module->busMode);
 
+		menu->addChild(new MenuSeparator);
+		appendSeedMenu(menu, &module->seed);
 
+		static const char* const stateNames[2] = {"A", "B"};
+		menu->addChild(new MenuSeparator);
+		appendOccupancyMenu<2>(menu, &module->stats, stateNames, "triggers", [=](int c, float P[2][2]) {
+			module->transitionMatrix(c, P);
+		});
+		menu->addChild(new MenuSeparator);
+		appendTraceMenu(menu, &module->trace);
+		appendProbeMenu(menu, &module->probe);
 	}
 };
 
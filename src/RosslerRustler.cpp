@@ -2,6 +2,12 @@
  * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
  */
 #include "plugin.hpp"
+#include "dsp/Rossler.hpp"
+#include "ParamRamps.hpp"
+#include "Instrument.hpp"
+#include "Trace.hpp"
+#include "StateBlob.hpp"
+#include "QualityGovernor.hpp"
 
 struct RosslerRustlerModule : Module 
 {
@@ -11,6 +17,7 @@ struct RosslerRustlerModule : Module
         C_PARAM,
 		EXT_GAIN_PARAM,
 		EXT_MIX_PARAM,
+		COUPLING_PARAM,
         NUM_PARAMS
     };
     enum InputIds {
@@ -24,34 +31,46 @@ struct RosslerRustlerModule : Module
 		// Z_OUTPUT,
 		NUM_OUTPUTS
 	};
+	enum LightIds {
+		ENUMS(QUALITY_LIGHT, 2),
+		NUM_LIGHTS
+	};
+
+	zcdsp::Rossler rossler;
+	ParamRamps<NUM_PARAMS> knobs;
+    instrument::Probe probe{this};
+	TraceRecorder trace{"RosslerRustler", {"x", "y", "z"}};
+	// each level halves the integration rate
+	QualityGovernor governor;
 
-    float xout[16] = {0};
-	float yout[16] = {0};
-	float zout[16] = {0};
-	int mProcMode = 1; 
     RosslerRustlerModule() {
-		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS);
+		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(A_PARAM, 0.f, 1.f, 0.2f, "A dynamical parameter");
 		configParam(B_PARAM, 0.f, 1.f, 0.2f, "B dynamical parameter");
 		configParam(C_PARAM, 0.f, 30.f, 5.7f, "C dynamical parameter");
 		configParam(EXT_GAIN_PARAM, 0.f, 10.f, 1.f, "External Gain");
 		configParam(EXT_MIX_PARAM, 0.f, 1.f, 0.5f, "Internal/External Mix");
+		configParam(COUPLING_PARAM, 0.f, 1.f, 0.f, "Coupling between channels");
 
 		configInput(PITCH_INPUT, "Set pitch V/oct");
 		configInput(EXT_INPUT, "External signal");
 
 		configOutput(X_OUTPUT, "X component of Rossler system");
-
-		for (int c = 0; c < 16; c++){
-			xout[c] = 0.f;
-			yout[c] = 5.f;
-			zout[c] = 0.f;
-		}
-		
+		rossler.setSampleRate(APP->engine->getSampleRate());
 	};
 	json_t *dataToJson() override {
 		json_t *rootJ = json_object();
-		json_object_set_new(rootJ, "procmode", json_integer(mProcMode));
+		json_object_set_new(rootJ, "procmode", json_integer(rossler.legacyStep ? 0 : 1));
+		json_object_set_new(rootJ, "topology", json_integer(rossler.topology));
+		json_object_set_new(rootJ, "cyclecache", json_boolean(rossler.cycleCache));
+		governor.dataToJson(rootJ);
+		float x[16], y[16], z[16];
+		rossler.settledState(x, y, z);
+		StateBlob state;
+		state.write(x);
+		state.write(y);
+		state.write(z);
+		state.toJson(rootJ);
 		return rootJ;
 	}
 	void dataFromJson(json_t *rootJ) override {
@@ -60,57 +79,76 @@ struct RosslerRustlerModule : Module
 		json_t *procmodej = json_object_get(rootJ, "procmode");
 		if (procmodej)
 		{
-			mProcMode = json_integer_value(procmodej);
+			rossler.legacyStep = json_integer_value(procmodej) != 1;
+		}
+		json_t *topologyj = json_object_get(rootJ, "topology");
+		if (topologyj)
+		{
+			int topology = json_integer_value(topologyj);
+			if (topology >= 0 && topology < zcdsp::Rossler::NUM_TOPOLOGIES)
+				rossler.topology = (zcdsp::Rossler::Topology) topology;
+		}
+		json_t *cyclecachej = json_object_get(rootJ, "cyclecache");
+		if (cyclecachej)
+			rossler.cycleCache = json_is_true(cyclecachej);
+		governor.dataFromJson(rootJ);
+		StateBlob state;
+		if (state.fromJson(rootJ, sizeof(rossler.x) + sizeof(rossler.y) + sizeof(rossler.z))) {
+			state.read(rossler.x);
+			state.read(rossler.y);
+			state.read(rossler.z);
+			rossler.forgetCycles();
 		}
 	}
-	void RosslerSlope(float x, float y, float z,float a, float b, float c, float pert, float* output){
-		output[0] = -y-z;
-		output[1] = x + a*y + pert;
-		output[2] = b + z*(x-c);
+
+	void onSampleRateChange() override {
+		rossler.setSampleRate(APP->engine->getSampleRate());
 	}
 
 	void process(const ProcessArgs& args) override {
+		instrument::Scope timer(probe);
+		QualityGovernor::Scope governed(governor, args.sampleRate);
 
 		int channels = std::max(inputs[PITCH_INPUT].getChannels(),1);
-
-		float A = params[A_PARAM].getValue();
-		float B = params[B_PARAM].getValue();
-		float C = params[C_PARAM].getValue();
-		float gain = params[EXT_GAIN_PARAM].getValue();
-		float mix = params[EXT_MIX_PARAM].getValue();
+		rossler.stride = 1 << governor.level;
+		governor.setLight(&lights[QUALITY_LIGHT]);
+		bool stepping = rossler.beginFrame();
+
+		knobs.process(this);
+		zcdsp::Rossler::Controls k;
+		k.a = knobs.get(A_PARAM);
+		k.b = knobs.get(B_PARAM);
+		k.c = knobs.get(C_PARAM);
+		k.coupling = knobs.get(COUPLING_PARAM);
+		float gain = knobs.get(EXT_GAIN_PARAM);
+		float mix = knobs.get(EXT_MIX_PARAM);
+		// the trace gets x, y and z before clamping
+		float* traced = trace.beginFrame(args.frame, channels);
+
+		if (stepping) {
+			float pitch[16];
+			float pert[16];
+			for (int c = 0; c < channels; c++) {
+				pitch[c] = inputs[PITCH_INPUT].getVoltage(c);
+				pert[c] = inputs[EXT_INPUT].getVoltage(c)*gain;
+			}
+			rossler.stepAll(channels, k, pitch, pert, traced);
+		}
 
 		for (int c = 0; c < channels; c++) {
-			float pitch = inputs[PITCH_INPUT].getVoltage(c);
-			pitch = dsp::FREQ_C4 * std::pow(2.f, pitch)*6.2831853f;
-			float dt = args.sampleTime * pitch/2.0f;
 			float ext = inputs[EXT_INPUT].getVoltage(c);
-			float k[3];
-			RosslerSlope(xout[c], yout[c], zout[c], A, B, C, ext*gain,k);
-			float k2[3];
-			RosslerSlope(xout[c] + k[0] * dt, yout[c] + k[1] * dt, zout[c] + k[2] * dt, A, B, C, ext*gain,k2);
-			if (mProcMode == 1)
-			{
-				xout[c] += (k[0] + k2[0] )* dt;
-				yout[c] += (k[1] + k2[1] )* dt;
-				zout[c] += (k[2] + k2[2] )* dt;
-			} else // old behavior where the k and k2 pointers were both pointing to the same array
-			{
-				xout[c] += (k2[0] + k2[0] )* dt;
-				yout[c] += (k2[1] + k2[1] )* dt;
-				zout[c] += (k2[2] + k2[2] )* dt;
+			if (!stepping && traced) {
+				traced[c*3] = rossler.x[c];
+				traced[c*3 + 1] = rossler.y[c];
+				traced[c*3 + 2] = rossler.z[c];
 			}
-			
-
-			xout[c] = clamp(xout[c],-20.f,20.f);
-			yout[c] = clamp(yout[c],-20.f,20.f);
-			zout[c] = clamp(zout[c],-20.f,20.f);
-
-
-			outputs[X_OUTPUT].setVoltage(xout[c]/3.0f*(1-mix) + mix*ext,c);
-			// outputs[Y_OUTPUT].setVoltage(yout[c]/3.0f,c);
-			// outputs[Z_OUTPUT].setVoltage(zout[c]/3.0 - 3.5f,c);
+			outputs[X_OUTPUT].setVoltage(rossler.output(c)/3.0f*(1-mix) + mix*ext,c);
+			// outputs[Y_OUTPUT].setVoltage(rossler.y[c]/3.0f,c);
+			// outputs[Z_OUTPUT].setVoltage(rossler.z[c]/3.0 - 3.5f,c);
 		}
 		outputs[X_OUTPUT].setChannels(channels);
+		if (traced)
+			trace.endFrame();
 		// outputs[Y_OUTPUT].setChannels(channels);
 		// outputs[Z_OUTPUT].setChannels(channels);
         
@@ -135,9 +173,12 @@ struct RosslerRustlerWidget : ModuleWidget {
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(xc2, 62.)), module, RosslerRustlerModule::EXT_GAIN_PARAM));
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(xc, 76.)), module, RosslerRustlerModule::EXT_MIX_PARAM));
 
+		addParam(createParamCentered<Trimpot>(mm2px(Vec(xc2, 82.5)), module, RosslerRustlerModule::COUPLING_PARAM));
+
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(xc2, 90)), module, RosslerRustlerModule::PITCH_INPUT));
 		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(xc, 104)), module, RosslerRustlerModule::EXT_INPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(xc2, 118)), module, RosslerRustlerModule::X_OUTPUT));
+		addChild(createLightCentered<SmallLight<GreenRedLight>>(mm2px(Vec(xc2, 25.)), module, RosslerRustlerModule::QUALITY_LIGHT));
 		// addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(10.32, 88)), module, RosslerRustlerModule::Y_OUTPUT));
 		// addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(10.32, 102)), module, RosslerRustlerModule::Z_OUTPUT));
 
@@ -151,15 +192,52 @@ struct RosslerRustlerWidget : ModuleWidget {
 			
 			void onAction(const event::Action &e) override
 			{
-				if (module->mProcMode == 0)
-					module->mProcMode = 1;
-				else module->mProcMode = 0;
+				module->rossler.legacyStep = !module->rossler.legacyStep;
 			}
 		};
-		ModeMenuItem *modeItem = createMenuItem<ModeMenuItem>("Updated processing behavior", CHECKMARK(module->mProcMode));
+		ModeMenuItem *modeItem = createMenuItem<ModeMenuItem>("Updated processing behavior", CHECKMARK(!module->rossler.legacyStep));
 		modeItem->module = module;
 		menu->addChild(modeItem);
 
+		struct TopologyMenuItem : MenuItem
+		{
+			RosslerRustlerModule* module = nullptr;
+			zcdsp::Rossler::Topology topology = zcdsp::Rossler::RING;
+
+			void onAction(const event::Action &e) override
+			{
+				module->rossler.topology = topology;
+			}
+		};
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createMenuLabel("Channel coupling"));
+		const char* topologyNames[] = {"Ring", "Chain (open ends)", "All to all"};
+		for (int t = 0; t < zcdsp::Rossler::NUM_TOPOLOGIES; t++) {
+			TopologyMenuItem *topologyItem = createMenuItem<TopologyMenuItem>(topologyNames[t], CHECKMARK(module->rossler.topology == t));
+			topologyItem->module = module;
+			topologyItem->topology = (zcdsp::Rossler::Topology) t;
+			menu->addChild(topologyItem);
+		}
+
+		struct CycleCacheMenuItem : MenuItem
+		{
+			RosslerRustlerModule* module = nullptr;
+
+			void onAction(const event::Action &e) override
+			{
+				module->rossler.cycleCache = !module->rossler.cycleCache;
+			}
+		};
+		menu->addChild(new MenuSeparator);
+		CycleCacheMenuItem *cycleCacheItem = createMenuItem<CycleCacheMenuItem>("Play settled cycles from a table", CHECKMARK(module->rossler.cycleCache));
+		cycleCacheItem->module = module;
+		menu->addChild(cycleCacheItem);
+
+		appendGovernorMenu(menu, &module->governor);
+
+		menu->addChild(new MenuSeparator);
+		appendTraceMenu(menu, &module->trace);
+		appendProbeMenu(menu, &module->probe);
 	}
 };
 
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+#include "dsp/Random.hpp"
+#include <atomic>
+
+// How a module seeds its engine's random stream: a fresh seed per instance, or
+// a fixed one stored with the patch so the stream restarts from it whenever
+// the patch is loaded. The context menu only requests a reseed; the module's
+// process() calls applyReseed() first thing, so the stream is never reseeded
+// under a draw.
+struct SeedSetting {
+	zcrandom::Stream* rng;
+	bool fixedSeed = false;
+	uint32_t seedValue = 0;
+	std::atomic<bool> reseedPending{false};
+
+	SeedSetting(zcrandom::Stream* rng) : rng(rng) {}
+
+	// UI thread
+	void setFixedSeed(bool fixed) {
+		fixedSeed = fixed;
+		if (fixed) {
+			seedValue = random::u32();
+			requestReseed();
+		}
+	}
+
+	void requestReseed() {
+		reseedPending.store(true, std::memory_order_release);
+	}
+
+	// Audio thread
+	void applyReseed() {
+		if (reseedPending.load(std::memory_order_acquire)) {
+			reseedPending.store(false, std::memory_order_relaxed);
+			rng->reseed(seedValue);
+		}
+	}
+
+	void dataToJson(json_t* rootJ) {
+		if (fixedSeed)
+			json_object_set_new(rootJ, "seed", json_integer(seedValue));
+	}
+
+	void dataFromJson(json_t* rootJ) {
+		json_t* seedJ = json_object_get(rootJ, "seed");
+		fixedSeed = seedJ != nullptr;
+		if (fixedSeed) {
+			seedValue = (uint32_t) json_integer_value(seedJ);
+			rng->reseed(seedValue);
+		}
+		reseedPending.store(false);
+	}
+};
+
+// Context menu toggle between a fresh seed per instance and a stored, reproducible one.
+inline void appendSeedMenu(Menu* menu, SeedSetting* seed) {
+	struct FixedSeedItem : MenuItem {
+		SeedSetting* seed = nullptr;
+		void onAction(const event::Action& e) override {
+			seed->setFixedSeed(!seed->fixedSeed);
+		}
+	};
+	struct RestartItem : MenuItem {
+		SeedSetting* seed = nullptr;
+		void onAction(const event::Action& e) override {
+			seed->requestReseed();
+		}
+	};
+	FixedSeedItem* fixedItem = createMenuItem<FixedSeedItem>("Fixed random seed (reproducible)", CHECKMARK(seed->fixedSeed));
+	fixedItem->seed = seed;
+	menu->addChild(fixedItem);
+	if (seed->fixedSeed) {
+		RestartItem* restartItem = createMenuItem<RestartItem>(string::f("Restart from seed %u", seed->seedValue));
+		restartItem->seed = seed;
+		menu->addChild(restartItem);
+	}
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+#include <cstring>
+#include <vector>
+
+// A module's dynamical state (oscillator phases, integrator values, Markov
+// states), saved with the patch so it loads sounding the way it was saved
+// instead of settling from rest. The members are packed as raw bytes in the
+// order written and stored as base64 under "state". A blob whose size doesn't
+// match the layout, e.g. from another version, is ignored and the module
+// starts from its usual initial state.
+struct StateBlob {
+	std::vector<uint8_t> bytes;
+	size_t offset = 0;
+
+	template <typename T>
+	void write(const T& value) {
+		const uint8_t* p = (const uint8_t*) &value;
+		bytes.insert(bytes.end(), p, p + sizeof(T));
+	}
+
+	template <typename T>
+	void read(T& value) {
+		std::memcpy(&value, &bytes[offset], sizeof(T));
+		offset += sizeof(T);
+	}
+
+	void toJson(json_t* rootJ) const {
+		json_object_set_new(rootJ, "state", json_string(string::toBase64(bytes.data(), bytes.size()).c_str()));
+	}
+
+	// true when rootJ holds a blob of exactly size bytes, ready to read
+	bool fromJson(json_t* rootJ, size_t size) {
+		json_t* stateJ = json_object_get(rootJ, "state");
+		if (!stateJ || !json_is_string(stateJ))
+			return false;
+		try {
+			bytes = string::fromBase64(json_string_value(stateJ));
+		}
+		catch (std::exception& e) {
+			return false;
+		}
+		offset = 0;
+		return bytes.size() == size;
+	}
+};
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#include "Trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+TraceRecorder::TraceRecorder(const std::string& slug, std::vector<std::string> fieldNames)
+	: slug(slug), fieldNames(fieldNames), head(0), tail(0), dropped(0), recording(false), stopping(false) {
+	if (this->fieldNames.size() > MAX_FIELDS)
+		this->fieldNames.resize(MAX_FIELDS);
+	frameBytes = sizeof(TraceFrameHeader) + 16*this->fieldNames.size()*sizeof(float);
+}
+
+TraceRecorder::~TraceRecorder() {
+	stop();
+}
+
+void TraceRecorder::start(float sampleRate) {
+	if (recording)
+		return;
+	char stamp[32];
+	std::time_t now = std::time(nullptr);
+	std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+	path = asset::user(string::f("ZetaCarinae-%s-%s.zctrace", slug.c_str(), stamp));
+	file = std::fopen(path.c_str(), "wb");
+	if (!file)
+		return;
+
+	TraceHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "ZCTRACE1", 8);
+	header.frameBytes = frameBytes;
+	header.fields = fieldNames.size();
+	header.maxChannels = 16;
+	header.sampleRate = sampleRate;
+	std::strncpy(header.slug, slug.c_str(), sizeof(header.slug) - 1);
+	for (size_t i = 0; i < fieldNames.size(); i++)
+		std::strncpy(header.fieldNames[i], fieldNames[i].c_str(), sizeof(header.fieldNames[i]) - 1);
+	std::fwrite(&header, sizeof(header), 1, file);
+
+	if (ring.empty())
+		ring.resize((size_t) RING_FRAMES*frameBytes);
+	// frames pushed after the last stop belong to no recording
+	tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+	dropped = 0;
+	stopping = false;
+	writer = std::thread([this]() { run(); });
+	recording.store(true, std::memory_order_release);
+}
+
+void TraceRecorder::stop() {
+	if (!writer.joinable())
+		return;
+	recording = false;
+	stopping = true;
+	writer.join();
+	std::fclose(file);
+	file = nullptr;
+}
+
+void TraceRecorder::run() {
+	while (!stopping.load()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		drain();
+	}
+	drain();
+}
+
+// Writes everything the audio thread has published, in at most two runs of
+// contiguous frames.
+void TraceRecorder::drain() {
+	uint32_t t = tail.load(std::memory_order_relaxed);
+	uint32_t h = head.load(std::memory_order_acquire);
+	while (t != h) {
+		uint32_t index = t % RING_FRAMES;
+		uint32_t count = std::min(h - t, RING_FRAMES - index);
+		std::fwrite(&ring[(size_t) index*frameBytes], frameBytes, count, file);
+		t += count;
+		tail.store(t, std::memory_order_release);
+	}
+}
+
+void appendTraceMenu(Menu* menu, TraceRecorder* trace) {
+	struct RecordItem : MenuItem {
+		TraceRecorder* trace = nullptr;
+		void onAction(const event::Action& e) override {
+			if (trace->recording)
+				trace->stop();
+			else
+				trace->start(APP->engine->getSampleRate());
+		}
+	};
+	RecordItem* recordItem = createMenuItem<RecordItem>("Record internal state", CHECKMARK(trace->recording));
+	recordItem->trace = trace;
+	menu->addChild(recordItem);
+	if (trace->recording) {
+		menu->addChild(createMenuLabel(string::f("Writing %s", trace->path.c_str())));
+		if (trace->dropped > 0)
+			menu->addChild(createMenuLabel(string::f("%u frames dropped", (unsigned) trace->dropped)));
+	}
+}
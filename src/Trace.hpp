@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Records a module's internal state, one fixed-size frame per sample, to a
+// .zctrace file in the Rack user folder; tools/tracedump turns it into CSV or
+// NumPy. Started and stopped from the context menu.
+//
+// The audio thread writes frames straight into a single-producer ring and
+// never blocks: when the writer falls behind, frames are dropped, which shows
+// as a gap in the recorded sample numbers. A writer thread drains the ring to
+// the file every few ms.
+//
+// File layout, little endian: a TraceHeader, then frames of
+// TraceHeader::frameBytes each, so frame i is at sizeof(TraceHeader) + i*frameBytes.
+// A frame is a TraceFrameHeader and maxChannels*fields floats, channel major.
+struct TraceHeader {
+	char magic[8]; // "ZCTRACE1"
+	uint32_t frameBytes;
+	uint32_t fields;
+	uint32_t maxChannels;
+	float sampleRate;
+	char slug[32];
+	char fieldNames[8][16];
+};
+
+struct TraceFrameHeader {
+	uint64_t sample;
+	uint32_t channels;
+	uint32_t reserved;
+};
+
+struct TraceRecorder {
+	static const int MAX_FIELDS = 8;
+	static const uint32_t RING_FRAMES = 1 << 14; // ~0.34 s at 48 kHz
+
+	std::string slug;
+	std::vector<std::string> fieldNames;
+	uint32_t frameBytes = 0;
+	std::string path; // file of the current or last recording
+
+	// ring of RING_FRAMES frames, allocated by the first start()
+	std::vector<char> ring;
+	std::atomic<uint32_t> head; // next frame the audio thread writes
+	std::atomic<uint32_t> tail; // next frame the writer reads
+	std::atomic<uint32_t> dropped;
+	std::atomic<bool> recording;
+	std::atomic<bool> stopping;
+	std::thread writer;
+	FILE* file = nullptr;
+
+	TraceRecorder(const std::string& slug, std::vector<std::string> fieldNames);
+	~TraceRecorder();
+
+	// UI thread
+	void start(float sampleRate);
+	void stop();
+
+	// Audio thread: a frame to fill with channels*fields values, or nullptr
+	// when not recording or the ring is full.
+	float* beginFrame(int64_t sample, int channels) {
+		// acquire: start() allocates the ring before it sets recording
+		if (!recording.load(std::memory_order_acquire))
+			return nullptr;
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) >= RING_FRAMES) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		char* frame = &ring[(size_t) (h % RING_FRAMES)*frameBytes];
+		TraceFrameHeader* header = (TraceFrameHeader*) frame;
+		header->sample = sample;
+		header->channels = channels;
+		header->reserved = 0;
+		float* values = (float*) (frame + sizeof(TraceFrameHeader));
+		std::fill(values + channels*fieldNames.size(), values + 16*fieldNames.size(), 0.f);
+		return values;
+	}
+
+	void endFrame() {
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+private:
+	void run();
+	void drain();
+};
+
+void appendTraceMenu(Menu* menu, TraceRecorder* trace);
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "plugin.hpp"
+#include <cstdint>
+
+// Schmitt triggers for all 16 polyphony channels of one input, evaluated four
+// channels per compare. process() returns a bitmask with bit c set when channel c
+// saw a rising edge this sample, so callers only visit channels that fired.
+struct TriggerBank {
+	dsp::TSchmittTrigger<simd::float_4> triggers[4];
+
+	void reset() {
+		for (int i = 0; i < 4; i++)
+			triggers[i].reset();
+	}
+
+	uint32_t process(Input& input, int channels) {
+		uint32_t mask = 0;
+		for (int c = 0; c < channels; c += 4) {
+			simd::float_4 v = input.getVoltageSimd<simd::float_4>(c);
+			mask |= (uint32_t) simd::movemask(triggers[c/4].process(v)) << c;
+		}
+		return mask & (uint32_t) ((1ull << channels) - 1);
+	}
+};
+
+// Index of the lowest set bit; used to walk the channels in a trigger mask.
+inline int firstChannel(uint32_t mask) {
+	return __builtin_ctz(mask);
+}
@@ -2,7 +2,14 @@
  * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
  */
 #include "plugin.hpp"
-#include <vector>
+#include "dsp/Warbler.hpp"
+#include "SeedSetting.hpp"
+#include "ControlScheduler.hpp"
+#include "ConnectionCache.hpp"
+#include "ParamRamps.hpp"
+#include "Instrument.hpp"
+#include "StateBlob.hpp"
+#include "QualityGovernor.hpp"
 
 struct WarblerModule : Module 
 {
@@ -31,44 +38,25 @@ struct WarblerModule : Module
 		Y_OUTPUT,
 		NUM_OUTPUTS
 	};
-	static const int normalRandomTableSize = 1000003;
-	std::vector<float> normalRandomTable;
-	int normalRandomTableIndex = 0;
-    float xoutsignal[16] = {0};
-	float youtsignal[16] = {0};
-	float xint[128] = {0};
-	float yint[128] = {1};
-    float sqrtdelta = 1.0f/std::sqrt(APP->engine->getSampleRate());
-	float dets[8] = {0,-1,2,-3,4,-5,6,-7};
-	//float dets[8] = {0.000929f,0.000377f,0.000076f,0.0f,0.000081f,0.000108f,0.000153f,0.000487f};
-    float indets[128] = {0.001f};
-	float mults[168] = {
-		0.03125, 0.0625,0.125,0.25,0.5, 0.5, 1.0, 1.0,
-		0.0625,  0.125, 0.25, 0.25,0.5, 0.5, 1.0, 1.0,
-		0.125,   0.25,  0.25, 0.5, 0.5, 0.5, 1.0, 1.0,
-		0.125,   0.25,  0.25, 0.5, 0.5, 1.0, 1.0, 1.0,
-		0.25,    0.25,  0.5,  0.5, 1.0, 1.0, 1.0, 1.0,
-		0.25,    0.5,   0.5,  0.5, 1.0, 1.0, 1.0, 2.0,
-		0.25,    0.5,   0.5,  1.0, 1.0, 1.0, 1.0, 2.0,
-		0.25,    0.5,   0.5,  1.0, 1.0, 1.0, 2.0, 2.0,
-		0.25,    0.5,   1.0,  1.0, 1.0, 1.0, 1.0, 2.0,
-		0.50,    0.5,   1.0,  1.0, 1.0, 1.0, 1.0, 2.0,
-		1.00,    1.0,   1.0,  1.0, 1.0, 1.0, 1.0, 1.0, 
-		1.00,    1.0,   1.0,  1.0, 1.0, 1.0, 1.0, 2.0,
-		0.50,    1.0,   1.0,  1.0, 1.0, 1.0, 2.0, 2.0,
-		0.50,    1.0,   1.0,  1.0, 1.0, 2.0, 2.0, 2.0,
-		0.50,    1.0,   1.0,  1.0, 2.0, 2.0, 2.0, 3.0,
-		// 0.50,    1.0,   1.0,  1.0, 2.0, 2.0, 3.0, 3.0,
-		1.00,    1.0,   1.0,  1.0, 2.0, 2.0, 3.0, 4.0,
-		1.00,    1.0,   1.0,  2.0, 2.0, 2.0, 3.0, 5.0,
-		1.00,    1.0,   2.0,  2.0, 3.0, 4.0, 5.0, 6.0,
-		1.00,    1.0,   2.0,  3.0, 4.0, 5.0, 6.0, 7.0,
-		1.00,    2.0,   3.0,  4.0, 5.0, 6.0, 7.0, 7.0,
-		1.00,    2.0,   3.0,  4.0, 5.0, 6.0, 7.0, 8.0,
+	enum LightIds {
+		ENUMS(QUALITY_LIGHT, 2),
+		NUM_LIGHTS
 	};
+	zcdsp::WarblerBank bank{random::u64()};
+	SeedSetting seed{&bank.rng};
+	// harmonic set per channel, a control-rate choice
+	int harmonics[16];
+	ControlScheduler harmonicsScheduler{250.f};
+	ConnectionCache connections;
+	ParamRamps<NUM_PARAMS> knobs;
+
+    instrument::Probe probe{this};
+	// each level halves the oscillators stepped and the harmonics update rate
+	QualityGovernor governor;
+	int qualityLevel = 0;
 
     WarblerModule() {
-		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS);
+		config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 		configParam(NOISE_PARAM, 0.f, 1.f, 0.01f, "Stochasticity");
 		configParam(DETUNE_PARAM, 0.f, 2.f, 0.0001f, "Variation/detune amount");
 		configParam(GAIN_PARAM, 0.f, 10.f, 1.0f, "Input influence");
@@ -87,16 +75,51 @@ struct WarblerModule : Module
 
 		configOutput(X_OUTPUT, "X value of summed oscillators");
 		configOutput(Y_OUTPUT, "Y value of summed oscillators");
-		normalRandomTable.resize(normalRandomTableSize);
-		for (size_t i=0;i<normalRandomTable.size();++i)
-			normalRandomTable[i] = random::normal();
+		for (int c = 0; c < 16; c++)
+			harmonics[c] = 10;
+		bank.setSampleRate(APP->engine->getSampleRate());
 	};
 
+	json_t *dataToJson() override {
+		json_t *rootJ = json_object();
+		seed.dataToJson(rootJ);
+		governor.dataToJson(rootJ);
+		StateBlob state;
+		state.write(bank.xint);
+		state.write(bank.yint);
+		state.write(bank.indets);
+		state.toJson(rootJ);
+		return rootJ;
+	}
+
+	void dataFromJson(json_t *rootJ) override {
+		if (rootJ == nullptr)
+			return;
+		seed.dataFromJson(rootJ);
+		governor.dataFromJson(rootJ);
+		StateBlob state;
+		if (state.fromJson(rootJ, sizeof(bank.xint) + sizeof(bank.yint) + sizeof(bank.indets))) {
+			state.read(bank.xint);
+			state.read(bank.yint);
+			state.read(bank.indets);
+		}
+	}
+
     void onSampleRateChange() override {
-		sqrtdelta = 1.0/std::sqrt(APP->engine->getSampleRate());
+		bank.setSampleRate(APP->engine->getSampleRate());
+		harmonicsScheduler.setSampleRate(APP->engine->getSampleRate());
 	};
 
 	void process(const ProcessArgs& args) override {
+		instrument::Scope timer(probe);
+		seed.applyReseed();
+		QualityGovernor::Scope governed(governor, args.sampleRate);
+		if (governor.level != qualityLevel) {
+			qualityLevel = governor.level;
+			bank.active = 8 >> qualityLevel;
+			harmonicsScheduler.setRate(250.f/(1 << qualityLevel), args.sampleRate);
+		}
+		governor.setLight(&lights[QUALITY_LIGHT]);
 
 		int channels = std::max(inputs[NOISE_INPUT].getChannels(),
 			std::max(inputs[DETUNE_INPUT].getChannels(),
@@ -104,46 +127,39 @@ struct WarblerModule : Module
 			std::max(inputs[PITCH_INPUT].getChannels(),
 			1))));
 
+		// X and Y come from the same coupled oscillators, so both are integrated
+		// while either is patched; with neither patched the oscillators just hold.
+		connections.process(this);
+		if (!connections.any()) {
+			outputs[X_OUTPUT].setChannels(channels);
+			outputs[Y_OUTPUT].setChannels(channels);
+			return;
+		}
+
+		knobs.process(this);
+		harmonicsScheduler.process(channels, [this](int c) {
+			probe.tick();
+			int hp = round(knobs.get(HARMN_PARAM) + knobs.get(HGAIN_PARAM)*inputs[HARMN_INPUT].getVoltage(c));
+			harmonics[c] = clamp(hp,0,20);
+		});
+
+		zcdsp::WarblerBank::Controls k[16];
+		float pitch[16];
+		float extin[16];
+		for (int c = 0; c < channels; c++) {
+			k[c].noise = knobs.get(NOISE_PARAM) + knobs.get(RGAIN_PARAM)*inputs[NOISE_INPUT].getVoltage(c);
+			k[c].detune = knobs.get(DETUNE_PARAM)/10.f + knobs.get(DGAIN_PARAM)*inputs[DETUNE_INPUT].getVoltage(c);
+			k[c].gain = knobs.get(GAIN_PARAM) + knobs.get(GGAIN_PARAM)*inputs[GAIN_INPUT].getVoltage(c);
+			k[c].harmonics = harmonics[c];
+			pitch[c] = inputs[PITCH_INPUT].getVoltage(c);
+			extin[c] = inputs[EXT_INPUT].getVoltage(c)/10.0f; // was /40.0f;
+		}
+		float x[16];
+		float y[16];
+		bank.stepAll(channels, k, pitch, extin, x, y);
 		for (int c = 0; c < channels; c++) {
-			float noise = params[NOISE_PARAM].getValue() + params[RGAIN_PARAM].getValue()*inputs[NOISE_INPUT].getVoltage(c);
-			float detune = params[DETUNE_PARAM].getValue()/10.f + params[DGAIN_PARAM].getValue()*inputs[DETUNE_INPUT].getVoltage(c);
-			float pitch = inputs[PITCH_INPUT].getVoltage(c);
-			float extin = inputs[EXT_INPUT].getVoltage(c)/10.0f; // was /40.0f;
-			float ingain = params[GAIN_PARAM].getValue() + params[GGAIN_PARAM].getValue()*inputs[GAIN_INPUT].getVoltage(c);
-			int hp = round(params[HARMN_PARAM].getValue() + params[HGAIN_PARAM].getValue()*inputs[HARMN_INPUT].getVoltage(c));
-			hp = clamp(hp,0,20);
-			
-			xoutsignal[c] = 0.f;
-			youtsignal[c] = 0.f;
-			for (int ri = 0; ri < 8; ri++) {
-				float rf = mults[hp*8 + ri];
-				pitch = clamp(pitch + indets[c*8 + ri], -5.f, 5.f);
-				float rad2 = xint[c*8 + ri]*xint[c*8 + ri] + yint[c*8 + ri]*yint[c*8 + ri];
-				
-				float kf = dsp::FREQ_C4 * std::pow(2.f, pitch)*6.2831853f;
-				float r = normalRandomTable[normalRandomTableIndex]*noise*sqrtdelta; 
-				++normalRandomTableIndex;
-				if (normalRandomTableIndex==normalRandomTableSize)
-					normalRandomTableIndex = 0;
-				float xdnew = rf*kf*(-yint[c*8 + ri] + 2.f*xint[c*8 + ri]*(1.0f - rad2) + ingain*extin)*args.sampleTime + r;
-				
-				yint[c*8 + ri] += rf*kf*(xint[c*8 + ri] + 2.f*yint[c*8 + ri]*(1.0f - rad2))*args.sampleTime;
-				xint[c*8 + ri] += xdnew;
-				indets[c*8 + ri] += rf*kf*(r + dets[ri]*detune - indets[c*8 + ri])*args.sampleTime;
-
-				xint[c*8 + ri] = clamp(xint[c*8 + ri], -1.25f, 1.25f);
-				yint[c*8 + ri] = clamp(yint[c*8 + ri], -1.25f, 1.25f);
-
-				xoutsignal[c] += xint[c*8 + ri];
-				youtsignal[c] += yint[c*8 + ri];
-				
-			}
-
-			xoutsignal[c] = clamp(xoutsignal[c]/2.f,-5.f,5.f);
-			youtsignal[c] = clamp(youtsignal[c]/2.f,-5.f,5.f);
-
-			outputs[X_OUTPUT].setVoltage(xoutsignal[c],c);
-			outputs[Y_OUTPUT].setVoltage(youtsignal[c],c);
+			outputs[X_OUTPUT].setVoltage(x[c],c);
+			outputs[Y_OUTPUT].setVoltage(y[c],c);
 		}
 		outputs[X_OUTPUT].setChannels(channels);
 		outputs[Y_OUTPUT].setChannels(channels);
@@ -180,9 +196,19 @@ struct WarblerWidget : ModuleWidget {
 
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(10, 114)), module, WarblerModule::X_OUTPUT));
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(21, 114)), module, WarblerModule::Y_OUTPUT));
+		addChild(createLightCentered<SmallLight<GreenRedLight>>(mm2px(Vec(15.5, 104.5)), module, WarblerModule::QUALITY_LIGHT));
+
 
 
+	}
 
+	void appendContextMenu(Menu *menu) override {
+		WarblerModule *module = dynamic_cast<WarblerModule*>(this->module);
+		menu->addChild(new MenuSeparator);
+		appendSeedMenu(menu, &module->seed);
+		menu->addChild(new MenuSeparator);
+		appendGovernorMenu(menu, &module->governor);
+		appendProbeMenu(menu, &module->probe);
 	}
 };
 
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include "FastMath.hpp"
+#include "Random.hpp"
+#include "Variants.hpp"
+
+namespace zcdsp {
+
+// Up to 16 Brownian bridges, each wandering from offset to range+offset over
+// a transition time of 2^time seconds and then holding there. A trigger, or a
+// change of transition time, starts a channel over.
+struct Bridge {
+	struct Controls {
+		float noise = 0.f;
+		float range = 5.f;
+		float offset = 0.f;
+		float time = 1.f;
+	};
+	// per-channel CV, added to the controls (noise at 1/10 scale, time in
+	// seconds after the exponential); a variant reads only the inputs its mask names
+	struct CV {
+		const float* range = nullptr;
+		const float* offset = nullptr;
+		const float* noise = nullptr;
+		const float* time = nullptr;
+	};
+	enum CVBits {
+		RANGE_CV = 1 << 0,
+		OFFSET_CV = 1 << 1,
+		NOISE_CV = 1 << 2,
+		TIME_CV = 1 << 3,
+		NUM_CV = 4
+	};
+	typedef void (Bridge::*ProcessFn)(int, const Controls&, const CV&, uint32_t, float*);
+
+	float outsignal[16] = {0};
+	float internaltime[16] = {0};
+	float internalmaxtime[16] = {5};
+	// channels that have reached range+offset and are holding it
+	uint32_t arrived = 0;
+	zcrandom::Stream rng;
+	float sampleTime = 1.f/44100.f;
+	float sqrtdelta = 1.0/std::sqrt(44100.f);
+
+	Bridge(uint64_t seed = 0) : rng(seed) {}
+
+	void setSampleRate(float sampleRate) {
+		sampleTime = 1.f/sampleRate;
+		sqrtdelta = 1.0/std::sqrt(sampleRate);
+	}
+
+	static const VariantTable<Bridge, ProcessFn, 1 << NUM_CV>& variants() {
+		static const VariantTable<Bridge, ProcessFn, 1 << NUM_CV> table;
+		return table;
+	}
+
+	// One sample for the CV inputs in Mask, restarting the triggered channels;
+	// out gets each channel's value.
+	template <uint32_t Mask>
+	void processVariant(int channels, const Controls& k, const CV& cv, uint32_t triggered, float* out) {
+		const bool rangeCV = Mask & RANGE_CV;
+		const bool offsetCV = Mask & OFFSET_CV;
+		const bool noiseCV = Mask & NOISE_CV;
+		const bool timeCV = Mask & TIME_CV;
+		const float timeScale = fastmath::exp2(k.time);
+
+		// Every channel at its endpoint and nothing restarting one: just follow range+offset,
+		// without drawing noise.
+		uint32_t channelMask = (uint32_t) ((1ull << channels) - 1);
+		if (!triggered && (arrived & channelMask) == channelMask && holdVariant<Mask>(channels, k, cv, timeScale, out))
+			return;
+
+		float noiseDraws[16];
+		rng.normals(noiseDraws, channels);
+		for (int c = 0; c < channels; c++) {
+			float range = rangeCV ? k.range + cv.range[c] : k.range;
+			float offset = offsetCV ? k.offset + cv.offset[c] : k.offset;
+			float noise = noiseCV ? k.noise + cv.noise[c]/10.0f : k.noise;
+			float timeParam = timeCV ? timeScale + cv.time[c] : timeScale;
+
+			if (((triggered >> c) & 1) || timeParam!=internalmaxtime[c]){
+				arrived &= ~(1u << c);
+				internaltime[c] = 0.f;
+				outsignal[c] = offset;
+				internalmaxtime[c] = timeParam;
+			}
+
+			float r = noiseDraws[c];
+			//float maxout = std:max(range+offset,offset);
+			//float minout = std:min(range+offset,offset);
+
+			internaltime[c] += sampleTime;
+			internaltime[c] = clamp(internaltime[c],0.0f,timeParam);
+			if(internaltime[c] < timeParam*0.999999f){
+				outsignal[c] += sqrtdelta*r*noise*range;
+				outsignal[c] += sampleTime*(range+offset-outsignal[c])/(timeParam - internaltime[c]);
+				// outsignal[c] = clamp(outsignal[c], offset, range+offset);
+			}
+			else{
+				outsignal[c] = range+offset;
+				arrived |= 1u << c;
+			}
+			out[c] = outsignal[c];
+		}
+	}
+
+	// The hold path; false if a transition time changed, which restarts that channel.
+	template <uint32_t Mask>
+	bool holdVariant(int channels, const Controls& k, const CV& cv, float timeScale, float* out) {
+		const bool rangeCV = Mask & RANGE_CV;
+		const bool offsetCV = Mask & OFFSET_CV;
+		const bool timeCV = Mask & TIME_CV;
+		for (int c = 0; c < channels; c++) {
+			float timeParam = timeCV ? timeScale + cv.time[c] : timeScale;
+			if (timeParam != internalmaxtime[c])
+				return false;
+		}
+		for (int c = 0; c < channels; c++) {
+			float range = rangeCV ? k.range + cv.range[c] : k.range;
+			float offset = offsetCV ? k.offset + cv.offset[c] : k.offset;
+			outsignal[c] = range+offset;
+			out[c] = outsignal[c];
+		}
+		return true;
+	}
+
+	// Runs frames samples of channels channels at fixed controls with no CV or
+	// triggers; out is frame major.
+	void process(int frames, int channels, const Controls& k, float* out) {
+		for (int i = 0; i < frames; i++)
+			processVariant<0>(channels, k, CV(), 0, &out[i*channels]);
+	}
+};
+
+} // namespace zcdsp
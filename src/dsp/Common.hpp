@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include <simd/Vector.hpp>
+#include <simd/functions.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// The engines in src/dsp hold the modules' state and maths as plain classes:
+// sample rate and knob values are passed in, CV arrives as pointers to
+// per-channel voltages, and results are written to caller buffers. They use
+// only the header-only simd maths of the Rack SDK, never the engine, modules,
+// patch storage or UI, so they can be built and run without Rack (see tools/).
+// The modules in src/ are adapters that read ports and knobs and call them.
+namespace zcdsp {
+
+namespace simd = rack::simd;
+
+static const float FREQ_C4 = 261.6256f;
+
+// as rack::math::clamp, so engines behave exactly as the code they came from
+template <typename T>
+T clamp(T x, T a, T b) {
+	return std::max(std::min(x, b), a);
+}
+
+inline float clamp(float x, float a = 0.f, float b = 1.f) {
+	return std::fmax(std::fmin(x, b), a);
+}
+
+// CV voltage of channel c, 0 V when the input has no voltages (v is null)
+inline float voltage(const float* v, int c) {
+	return v ? v[c] : 0.f;
+}
+
+} // namespace zcdsp
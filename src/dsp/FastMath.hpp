@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include <cstdint>
+#include <cstring>
+
+// Polynomial exp2 and sine for the pitch and table paths, in scalar and float_4 form.
+// Errors against libm (double) at the exact argument, so including its rounding
+// to float, over dense sweeps:
+//   exp2(x), x in [-20, 20]: max relative error 4.0e-6, i.e. 0.007 cent
+//            (3.3e-6 from the polynomial, the rest from rounding x near 20)
+//   sin(x),  x in [-200, 200]: max absolute error 2.2e-5 (argument reduction),
+//            7e-7 for |x| < 2*pi
+namespace fastmath {
+
+namespace simd = rack::simd;
+using zcdsp::clamp;
+
+// the bounds above, checked by tools/build/fastmath
+const double EXP2_RELATIVE_ERROR = 4.0e-6;
+const double SIN_ERROR = 2.2e-5;
+const double SIN_ERROR_NEAR = 7e-7;
+
+// 2^x = 2^n * 2^f with n = round(x) and |f| <= 1/2; 2^f is the degree 5 Taylor
+// polynomial of e^(f ln 2), and 2^n goes straight into the exponent bits.
+// x is clamped to [-126, 126] so the result stays a normal float.
+inline float exp2(float x) {
+	x = clamp(x, -126.f, 126.f);
+	float n = std::round(x);
+	float f = x - n;
+	float p = 1.f + f*(0.69314718f + f*(0.24022651f + f*(0.05550411f + f*(0.00961813f + f*0.00133336f))));
+	int32_t bits = ((int32_t) n + 127) << 23;
+	float scale;
+	std::memcpy(&scale, &bits, sizeof(scale));
+	return p*scale;
+}
+
+inline simd::float_4 exp2(simd::float_4 x) {
+	x = simd::clamp(x, -126.f, 126.f);
+	simd::float_4 n = simd::round(x);
+	simd::float_4 f = x - n;
+	simd::float_4 p = 1.f + f*(0.69314718f + f*(0.24022651f + f*(0.05550411f + f*(0.00961813f + f*0.00133336f))));
+	__m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n.v), _mm_set1_epi32(127)), 23);
+	return p*simd::float_4(_mm_castsi128_ps(bits));
+}
+
+// sin(x) via t = x/(2 pi) reduced to [-1/4, 1/4] (using sin(pi - y) = sin(y)),
+// then the degree 11 odd Taylor polynomial of sin(2 pi t).
+inline float sin(float x) {
+	float t = x*0.15915494f;
+	t -= std::round(t);
+	if (t > 0.25f)
+		t = 0.5f - t;
+	else if (t < -0.25f)
+		t = -0.5f - t;
+	float y = t*6.2831853f;
+	float y2 = y*y;
+	return y*(1.f + y2*(-1.6666667e-1f + y2*(8.3333333e-3f + y2*(-1.9841270e-4f + y2*(2.7557319e-6f + y2*-2.5052108e-8f)))));
+}
+
+inline simd::float_4 sin(simd::float_4 x) {
+	simd::float_4 t = x*0.15915494f;
+	t -= simd::round(t);
+	t = simd::ifelse(t > 0.25f, 0.5f - t, t);
+	t = simd::ifelse(t < -0.25f, -0.5f - t, t);
+	simd::float_4 y = t*6.2831853f;
+	simd::float_4 y2 = y*y;
+	return y*(1.f + y2*(-1.6666667e-1f + y2*(8.3333333e-3f + y2*(-1.9841270e-4f + y2*(2.7557319e-6f + y2*-2.5052108e-8f)))));
+}
+
+} // namespace fastmath
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#include "Firefly.hpp"
+
+namespace zcdsp {
+
+FireflyBank::FireflyBank() {
+    // coupling curves
+	for (int i=0; i<102; i++){
+		Kcurves[0][i] = fastmath::sin((i-50.f)*npi/50.f);
+		Kcurves[1][i] = fastmath::sin(2.0f*(i-50.f)*npi/50.f);
+	}
+
+    // waveform lookup tables
+        float wave_amps[11][20] ={{1.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0,0.0},
+        {0.689,0.228,0.064,0.015,0.003,0.001,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000},
+{0.358,0.251,0.164,0.103,0.061,0.034,0.017,0.008,0.003,0.001,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000,0.000},
+{0.262,0.213,0.159,0.117,0.085,0.061,0.042,0.027,0.017,0.009,0.005,0.002,0.001,0.000,0.000,0.000,0.000,0.000,0.000,0.000},
+{0.211,0.192,0.151,0.116,0.092,0.070,0.053,0.039,0.029,0.020,0.013,0.008,0.004,0.002,0.001,0.000,0.000,0.000,0.000,0.000},
+{0.171,0.178,0.149,0.114,0.093,0.076,0.059,0.046,0.036,0.027,0.019,0.014,0.009,0.005,0.003,0.001,0.000,0.000,0.000,0.000},
+{0.136,0.161,0.153,0.116,0.091,0.079,0.065,0.050,0.040,0.032,0.024,0.018,0.013,0.009,0.006,0.003,0.002,0.001,0.000,0.000},
+{0.106,0.137,0.155,0.126,0.092,0.079,0.071,0.056,0.043,0.035,0.029,0.022,0.016,0.012,0.009,0.006,0.003,0.002,0.001,0.000},
+{0.084,0.108,0.147,0.141,0.100,0.076,0.072,0.064,0.049,0.038,0.032,0.026,0.020,0.015,0.011,0.008,0.005,0.003,0.001,0.000},
+{0.071,0.079,0.127,0.150,0.119,0.079,0.067,0.068,0.058,0.042,0.033,0.028,0.024,0.018,0.013,0.010,0.007,0.004,0.002,0.001},
+{0.067,0.041,0.069,0.126,0.152,0.117,0.070,0.057,0.063,0.060,0.045,0.031,0.026,0.024,0.019,0.014,0.009,0.007,0.004,0.002}
+        };
+        // each harmonic is evaluated once for four table positions and shared by all 11 tables
+        for (int i=0; i<7200; i+=4){
+            simd::float_4 pos = simd::float_4(i, i+1, i+2, i+3);
+            simd::float_4 acc[11];
+            for (int k=0; k<11; k++)
+                acc[k] = 0.f;
+            for (int j=0; j<20; j++){
+                simd::float_4 h = fastmath::sin(nt * pos * (gradus[j]+1.f)/7200.0f + j/10.0f);
+                for (int k=0; k<11; k++)
+                    acc[k] += h*wave_amps[k][j];
+            }
+            for (int k=0; k<11; k++)
+                acc[k].store(&waves[k][i]);
+        }
+
+	for (int c = 0; c < 16; c++) {
+		for (int i = 0; i < 5; i++) {
+			theta[c][i] = 0.f;
+			wind1s[i][c] = 0;
+			wind2s[i][c] = 1;
+			winners[i][c] = 0.f;
+		}
+	}
+}
+
+} // namespace zcdsp
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include "FastMath.hpp"
+#include "Kernels.hpp"
+
+namespace zcdsp {
+
+// Five Kuramoto-coupled phase oscillators per channel, up to 16 channels, each
+// reading a crossfade of two of 11 wavetables. The coupling curve morphs
+// between sin(d) and sin(2d) of the phase difference d.
+struct FireflyBank {
+	struct Controls {
+		float ratio[5] = {1.f, 1.01f, 0.99f, 0.5f, 3.f};
+		float charm[5] = {1.25f, 1.f, 1.f, 0.5f, 0.25f};
+		float wave[5] = {0.f, 0.f, 0.f, 1.f, 5.f};
+		float k = 0.01f;
+		float ktype = 0.f;
+		float gain = 1.f;
+	};
+
+	float theta[16][5];
+	float nt = 6.2831853f;
+	float npi = 3.14159265;
+	float waves[11][7200];
+	float Kcurves[2][102];
+	// wavetable choice, oscillator major as the kernels take it
+	int wind1s[5][16];
+	int wind2s[5][16];
+	float winners[5][16];
+	float gradus[20] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 14, 15, 16, 18, 20, 21, 24, 25, 27};
+	float sampleTime = 1.f/44100.f;
+	// A stride above 1 sums each oscillator's coupling terms only every
+	// stride-th sample of its channel and reuses the sums in between.
+	int couplingStride = 1;
+	int couplingPhase[16] = {0};
+	float couplings[16][5] = {};
+
+	FireflyBank();
+
+	void setSampleRate(float sampleRate) {
+		sampleTime = 1.f/sampleRate;
+	}
+
+	void setCouplingStride(int stride) {
+		couplingStride = stride;
+		for (int c = 0; c < 16; c++)
+			couplingPhase[c] = 0;
+	}
+
+	// Points channel c's oscillators at the wavetables for wave positions W (0 to 10).
+	void selectWaves(int c, const float* W) {
+		for (int i = 0; i < 5; i++) {
+			wind1s[i][c] = clamp((int) std::floor(W[i]), 0, 10);
+			wind2s[i][c] = clamp((int) std::floor(W[i])+1, 0, 10);
+			winners[i][c] = clamp(W[i] - std::floor(W[i]), 0.f, 1.f);
+		}
+	}
+
+	// Advances channel c by one sample and returns its summed waveform.
+	// ratios are frequency ratios (quantised to 1/720), charms the mix and
+	// coupling weights, and freq the reference frequency in radians per second.
+	// traced, when given, gets the five phases.
+	float step(int c, const float* ratios, const float* charms, float K, float Kt, float freq, float* traced = nullptr) {
+		float out = 0.f;
+		float ks[5];
+		float wlist[5];
+		for (int i = 0; i < 5; i++)
+			wlist[i] = std::round(720*ratios[i])/720.0f*freq;
+		bool refresh = false;
+		if (couplingStride > 1) {
+			refresh = couplingPhase[c] == 0;
+			if (refresh)
+				couplingPhase[c] = couplingStride;
+			couplingPhase[c]--;
+		}
+		for (int i = 0; i < 5; i++) {
+			ks[i] = wlist[i];
+			if (couplingStride == 1) {
+				for (int j = 0; j < 5; j++) {
+					if (i!=j){
+						int kindex = 50 + 50*((theta[c][j] - theta[c][i])/nt);
+						float coupling = Kcurves[0][kindex]*Kt;
+						coupling += Kcurves[1][kindex]*(1.f - Kt);
+						ks[i] += charms[j] * wlist[i] * K * coupling;
+					}
+				}
+			} else {
+				if (refresh) {
+					float sum = 0.f;
+					for (int j = 0; j < 5; j++) {
+						if (i!=j){
+							int kindex = 50 + 50*((theta[c][j] - theta[c][i])/nt);
+							sum += charms[j]*(Kcurves[0][kindex]*Kt + Kcurves[1][kindex]*(1.f - Kt));
+						}
+					}
+					couplings[c][i] = sum;
+				}
+				ks[i] += wlist[i]*K*couplings[c][i];
+			}
+			theta[c][i] += ks[i]*sampleTime;
+			theta[c][i] = theta[c][i] - std::floor(theta[c][i]/nt)*nt;
+			int windex = (int) std::floor(7200*theta[c][i]/nt);
+			out += waves[wind1s[i][c]][windex]*(1.0f - winners[i][c])*charms[i];
+			out += waves[wind2s[i][c]][windex]* winners[i][c]*charms[i];
+			if (traced)
+				traced[i] = theta[c][i];
+		}
+		return out;
+	}
+
+	// Advances every channel by one sample, through the kernels unless the
+	// coupling sums are strided or there is only one channel, which the scalar
+	// step() does faster; the same as step() on each channel in turn.
+	// ratios holds five per channel, K, Kt and freq one, and out gets each
+	// channel's summed waveform. traced, when given, gets the five phases of
+	// every channel.
+	void stepAll(int channels, const float* ratios, const float* charms, const float* K, const float* Kt, const float* freq, float* out, float* traced = nullptr) {
+		if (couplingStride != 1 || channels == 1) {
+			for (int c = 0; c < channels; c++)
+				out[c] = step(c, &ratios[c*5], charms, K[c], Kt[c], freq[c], traced ? traced + c*5 : nullptr);
+			return;
+		}
+		float phases[5][16];
+		float omega[5][16];
+		for (int c = 0; c < channels; c++) {
+			for (int i = 0; i < 5; i++) {
+				phases[i][c] = theta[c][i];
+				omega[i][c] = std::round(720*ratios[c*5 + i])/720.0f*freq[c];
+			}
+		}
+		FireflyLanes f = {channels, &phases[0][0], &omega[0][0], K, Kt, charms, &wind1s[0][0], &wind2s[0][0], &winners[0][0],
+			&waves[0][0], &Kcurves[0][0], sampleTime, nt, out};
+		kernels.firefly(f);
+		for (int c = 0; c < channels; c++) {
+			for (int i = 0; i < 5; i++) {
+				theta[c][i] = phases[i][c];
+				if (traced)
+					traced[c*5 + i] = phases[i][c];
+			}
+		}
+	}
+
+	// Reference frequency for a V/oct pitch, in radians per second.
+	float frequency(float voct) {
+		return FREQ_C4 * fastmath::exp2(voct)*nt;
+	}
+
+	// Runs frames samples of channels channels at fixed controls and pitch
+	// (V/oct); out gets the gained signal clamped to +-5, frame major.
+	void process(int frames, int channels, const Controls& k, float pitch, float* out) {
+		for (int c = 0; c < channels; c++)
+			selectWaves(c, k.wave);
+		float freq = frequency(pitch);
+		float Kt = clamp(k.ktype, 0.f, 1.f);
+		float ratios[16*5], Ks[16], Kts[16], freqs[16];
+		for (int c = 0; c < channels; c++) {
+			for (int i = 0; i < 5; i++)
+				ratios[c*5 + i] = k.ratio[i];
+			Ks[c] = k.k;
+			Kts[c] = Kt;
+			freqs[c] = freq;
+		}
+		for (int i = 0; i < frames; i++) {
+			float* frame = &out[i*channels];
+			stepAll(channels, ratios, k.charm, Ks, Kts, freqs, frame);
+			for (int c = 0; c < channels; c++)
+				frame[c] = clamp(frame[c]*k.gain, -5.f, 5.f);
+		}
+	}
+};
+
+} // namespace zcdsp
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include "Random.hpp"
+
+namespace zcdsp {
+
+// Up to 16 two-state hidden Markov models, stepped one event (trigger) at a
+// time. Each step either generates the next state and its emission, or, as a
+// decoder, takes an observed emission and infers the state.
+struct HiddenMarkov {
+	// A->A and B->B transition probabilities, and each state's e1 probability
+	// and e1/e2 emission values
+	struct Params {
+		float PA, PB, PAE1, PBE1, AE1, AE2, BE1, BE2;
+	};
+
+	float state[16] = {1.f}; //1=A, 2=B
+	zcrandom::Stream rng;
+
+	// Decoder: alpha is the normalised forward (filtered) posterior, logDelta the Viterbi scores and
+	// survivor the register-exchange survivor paths (bit k = state k steps back, 0=A, 1=B).
+	static const int maxLag = 16;
+	int viterbiLag = 4;
+	// std. dev. (V) of the match between observed and emission values, about the jitter of the
+	// observed sequence: a value a dozen widths from every emission value matches neither state
+	float emissionWidth = 0.1f;
+	float alpha[16][2];
+	float logDelta[16][2];
+	uint32_t survivor[16][2];
+	float emissionHistory[16][maxLag + 1];
+	int historyIndex[16] = {0};
+
+	HiddenMarkov(uint64_t seed = 0) : rng(seed) {
+		resetDecoder();
+	}
+
+	void resetDecoder() {
+		for (int c = 0; c < 16; c++) {
+			alpha[c][0] = 0.5f;
+			alpha[c][1] = 0.5f;
+			logDelta[c][0] = 0.f;
+			logDelta[c][1] = 0.f;
+			survivor[c][0] = 0;
+			survivor[c][1] = 1;
+			historyIndex[c] = 0;
+			for (int i = 0; i <= maxLag; i++)
+				emissionHistory[c][i] = 0.f;
+		}
+	}
+
+	static void transitionMatrix(const Params& p, float P[2][2]) {
+		P[0][0] = clamp(p.PA, 0.f, 1.f);
+		P[0][1] = 1.f - P[0][0];
+		P[1][1] = clamp(p.PB, 0.f, 1.f);
+		P[1][0] = 1.f - P[1][1];
+	}
+
+	// Likelihood of observing v from a state that emits e1 with probability p1 and e2 otherwise.
+	// The Gaussian normalisation is common to both states and cancels.
+	float emissionLikelihood(float v, float p1, float e1, float e2) {
+		p1 = clamp(p1, 0.f, 1.f);
+		float s = 0.5f/(emissionWidth*emissionWidth);
+		float l = p1*std::exp(-(v - e1)*(v - e1)*s) + (1.f - p1)*std::exp(-(v - e2)*(v - e2)*s);
+		return std::max(l, 1e-30f);
+	}
+
+	// One constant-time step of the forward filter and the fixed-lag Viterbi
+	// decoder for channel c, observing v. state[c] becomes the state decoded
+	// viterbiLag steps back; returns the observation from that step.
+	float decodeStep(int c, const Params& p, float v) {
+		float PA = clamp(p.PA, 0.f, 1.f);
+		float PB = clamp(p.PB, 0.f, 1.f);
+		float LA = emissionLikelihood(v, p.PAE1, p.AE1, p.AE2);
+		float LB = emissionLikelihood(v, p.PBE1, p.BE1, p.BE2);
+
+		// forward algorithm, renormalised every step so it never under- or overflows
+		float a = (alpha[c][0]*PA + alpha[c][1]*(1.f - PB))*LA;
+		float b = (alpha[c][0]*(1.f - PA) + alpha[c][1]*PB)*LB;
+		float norm = a + b;
+		if (norm > 0.f) {
+			alpha[c][0] = a/norm;
+			alpha[c][1] = b/norm;
+		}
+
+		// Viterbi in the log domain, survivors kept as shift registers
+		float lAA = std::log(std::max(PA, 1e-12f));
+		float lAB = std::log(std::max(1.f - PA, 1e-12f));
+		float lBB = std::log(std::max(PB, 1e-12f));
+		float lBA = std::log(std::max(1.f - PB, 1e-12f));
+		float toA0 = logDelta[c][0] + lAA;
+		float toA1 = logDelta[c][1] + lBA;
+		float toB0 = logDelta[c][0] + lAB;
+		float toB1 = logDelta[c][1] + lBB;
+		uint32_t survA = (toA0 >= toA1) ? (survivor[c][0] << 1) : (survivor[c][1] << 1);
+		uint32_t survB = ((toB0 >= toB1) ? (survivor[c][0] << 1) : (survivor[c][1] << 1)) | 1u;
+		float dA = std::max(toA0, toA1) + std::log(LA);
+		float dB = std::max(toB0, toB1) + std::log(LB);
+		float dmax = std::max(dA, dB);
+		logDelta[c][0] = dA - dmax;
+		logDelta[c][1] = dB - dmax;
+		survivor[c][0] = survA;
+		survivor[c][1] = survB;
+
+		uint32_t best = (dA >= dB) ? survA : survB;
+		int decoded = (best >> viterbiLag) & 1u;
+
+		// delay the observation by the same lag so the emission and state line up
+		historyIndex[c] = (historyIndex[c] + 1) % (maxLag + 1);
+		emissionHistory[c][historyIndex[c]] = v;
+		int delayed = (historyIndex[c] + maxLag + 1 - viterbiLag) % (maxLag + 1);
+
+		state[c] = decoded + 1.f;
+		return emissionHistory[c][delayed];
+	}
+
+	// Draws the next state of channel c into state[c] and returns its emission;
+	// a forced state (0=A, 1=B) replaces the transition draw.
+	float generateStep(int c, const Params& p, int forced = -1) {
+		float Tr = rng.uniform();
+		float Er = rng.uniform();
+		bool toA = (std::round(state[c])==1 && Tr < p.PA) || (std::round(state[c])==2 && Tr > p.PB);
+		if (forced >= 0)
+			toA = (forced == 0);
+		if (toA){ // now in state A
+			state[c] = 1.f;
+			return (Er < p.PAE1) ? p.AE1 : p.AE2;
+		}
+		else{ // state is B
+			state[c] = 2.f;
+			return (Er < p.PBE1) ? p.BE1 : p.BE2;
+		}
+	}
+};
+
+} // namespace zcdsp
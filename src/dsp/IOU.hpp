@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include "Random.hpp"
+#include "Variants.hpp"
+
+namespace zcdsp {
+
+// Up to 16 damped, integrated Ornstein-Uhlenbeck processes: a noisy velocity
+// (ou) pulled back by spring and pushing its integral (iou) towards mean.
+// Each output can be crossfaded with an external signal.
+struct IOUProcess {
+	struct Controls {
+		float noise = 2.f;
+		float spring = 1.f;
+		float damp = 1.f;
+		float mean = 0.f;
+		float mix = 0.f;
+	};
+	// per-channel CV, added to the controls (noise at 1/10 scale) except ext,
+	// the external signal; a variant reads only the inputs its mask names
+	struct CV {
+		const float* noise = nullptr;
+		const float* spring = nullptr;
+		const float* damp = nullptr;
+		const float* mean = nullptr;
+		const float* ext = nullptr;
+	};
+	enum CVBits {
+		NOISE_CV = 1 << 0,
+		SPRING_CV = 1 << 1,
+		DAMP_CV = 1 << 2,
+		MEAN_CV = 1 << 3,
+		EXT_CV = 1 << 4,
+		NUM_CV = 5
+	};
+	// where a variant writes the white noise, OU and IOU signals of each channel
+	struct Outputs {
+		float* rand;
+		float* ou;
+		float* iou;
+	};
+	typedef void (IOUProcess::*ProcessFn)(int, const Controls&, const CV&, const Outputs&);
+
+	float outrands[16] = {0};
+	float outous[16] = {0};
+	float outious[16] = {0};
+	zcrandom::Stream rng;
+	float sampleTime = 1.f/44100.f;
+	float sqrtdelta = 1.0/std::sqrt(44100.f);
+	// samples skipped while OU and IOU aren't listened to
+	int idleSamples = 0;
+
+	IOUProcess(uint64_t seed = 0) : rng(seed) {}
+
+	void setSampleRate(float sampleRate) {
+		sampleTime = 1.f/sampleRate;
+		sqrtdelta = 1.0/std::sqrt(sampleRate);
+	}
+
+	// One coarse Euler step over the idle samples, so OU/IOU keep drifting with
+	// the current parameters and pick up from a plausible state when patched.
+	void catchUp(int channels, const Controls& k, const CV& cv) {
+		float t = idleSamples*sampleTime;
+		float noiseDraws[16];
+		rng.normals(noiseDraws, channels);
+		for (int c = 0; c < channels; c++) {
+			float noise = k.noise + voltage(cv.noise, c)/10.0f;
+			float spring = k.spring + voltage(cv.spring, c);
+			float mean = k.mean + voltage(cv.mean, c);
+			float damp = k.damp + voltage(cv.damp, c);
+			outious[c] += outous[c]*t;
+			outous[c] += std::sqrt(t)*noiseDraws[c]*noise;
+			outous[c] += (-spring*outous[c] + damp*(mean - outious[c]))*t;
+		}
+		idleSamples = 0;
+	}
+
+	// Only the noise is wanted: draw it into rand, leave the integration to catchUp().
+	void processNoise(int channels, const Controls& k, const CV& cv, float* rand) {
+		float noiseDraws[16];
+		rng.normals(noiseDraws, channels);
+		for (int c = 0; c < channels; c++) {
+			float noise = k.noise + voltage(cv.noise, c)/10.0f;
+			outrands[c] = noiseDraws[c]*noise;
+			rand[c] = outrands[c]*(1.0f-k.mix) + k.mix*voltage(cv.ext, c);
+		}
+	}
+
+	static const VariantTable<IOUProcess, ProcessFn, 1 << NUM_CV>& variants() {
+		static const VariantTable<IOUProcess, ProcessFn, 1 << NUM_CV> table;
+		return table;
+	}
+
+	// One sample for the CV inputs in Mask.
+	template <uint32_t Mask>
+	void processVariant(int channels, const Controls& k, const CV& cv, const Outputs& out) {
+		const bool noiseCV = Mask & NOISE_CV;
+		const bool springCV = Mask & SPRING_CV;
+		const bool dampCV = Mask & DAMP_CV;
+		const bool meanCV = Mask & MEAN_CV;
+		const bool extCV = Mask & EXT_CV;
+		float noiseDraws[16];
+		rng.normals(noiseDraws, channels);
+		const float dry = 1.0f - k.mix;
+		for (int c = 0; c < channels; c++) {
+			float noise = noiseCV ? k.noise + cv.noise[c]/10.0f : k.noise;
+			float spring = springCV ? k.spring + cv.spring[c] : k.spring;
+			float mean = meanCV ? k.mean + cv.mean[c] : k.mean;
+			float damp = dampCV ? k.damp + cv.damp[c] : k.damp;
+			float wet = extCV ? k.mix*cv.ext[c] : 0.f;
+
+			float r = noiseDraws[c];
+			outrands[c] = r*noise;
+			outious[c] += outous[c]*sampleTime;
+			outous[c] += sqrtdelta*outrands[c];
+			outous[c] += (-spring*outous[c] + damp*(mean - outious[c]))*sampleTime;
+
+			out.rand[c] = outrands[c]*dry + wet;
+			out.ou[c] = outous[c]*dry + wet;
+			out.iou[c] = outious[c]*dry + wet;
+		}
+	}
+
+	// Runs frames samples of channels channels at fixed controls with no CV;
+	// each output buffer is frame major.
+	void process(int frames, int channels, const Controls& k, float* rand, float* ou, float* iou) {
+		for (int i = 0; i < frames; i++) {
+			Outputs out = {&rand[i*channels], &ou[i*channels], &iou[i*channels]};
+			processVariant<0>(channels, k, CV(), out);
+		}
+	}
+};
+
+} // namespace zcdsp
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+// The loops behind Kernels.hpp. Each Kernels*.cpp file includes this once,
+// with ZC_KERNEL_NS naming its namespace and ZC_KERNEL_NAME the set, and is
+// built with that set's flags. No include guard, on purpose. Rounding and
+// copies go through compiler builtins rather than <cmath> and <cstring>, whose
+// inline std:: overloads could be shared between the sets at link time.
+#include "Kernels.hpp"
+#include <cstdint>
+
+namespace zcdsp {
+namespace ZC_KERNEL_NS {
+
+static const float FREQ_C4 = 261.6256f;
+
+static inline float clampf(float x, float a, float b) {
+	x = x < b ? x : b;
+	return x > a ? x : a;
+}
+
+// fastmath::exp2, with std::round written out (half away from zero) so the
+// loop around it vectorises; the same bits
+static inline float exp2(float x) {
+	x = clampf(x, -126.f, 126.f);
+	float t = __builtin_truncf(x);
+	float d = x - t;
+	float n = (d >= 0.5f) ? t + 1.f : ((d <= -0.5f) ? t - 1.f : t);
+	float f = x - n;
+	float p = 1.f + f*(0.69314718f + f*(0.24022651f + f*(0.05550411f + f*(0.00961813f + f*0.00133336f))));
+	int32_t bits = ((int32_t) n + 127) << 23;
+	float scale;
+	__builtin_memcpy(&scale, &bits, sizeof(scale));
+	return p*scale;
+}
+
+static uint32_t normals(const uint32_t* u, float* out, int n, const uint32_t* kn, const float* wn) {
+	int32_t slow[32];
+	for (int l = 0; l < n; l++) {
+		int iz = u[l] >> 25;
+		int32_t hz = (int32_t) (u[l] << 7);
+		uint32_t magnitude = hz < 0 ? 0u - (uint32_t) hz : (uint32_t) hz;
+		out[l] = hz*wn[iz];
+		slow[l] = magnitude >= kn[iz];
+	}
+	uint32_t mask = 0;
+	for (int l = 0; l < n; l++)
+		mask |= (uint32_t) slow[l] << l;
+	return mask;
+}
+
+static void warbler(const WarblerLanes& w) {
+	for (int l = 0; l < w.lanes; l++) {
+		float kf = FREQ_C4 * exp2(w.pitch[l])*6.2831853f;
+		float rk = w.rate[l]*kf;
+		float x = w.x[l];
+		float y = w.y[l];
+		float rad2 = x*x + y*y;
+		float r = w.kick[l];
+		float xdnew = rk*(-y + 2.f*x*(1.0f - rad2) + w.push[l])*w.sampleTime + r;
+		y += rk*(x + 2.f*y*(1.0f - rad2))*w.sampleTime;
+		x += xdnew;
+		w.indets[l] += rk*(r + w.drift[l] - w.indets[l])*w.sampleTime;
+		w.x[l] = clampf(x, -1.25f, 1.25f);
+		w.y[l] = clampf(y, -1.25f, 1.25f);
+	}
+}
+
+// Oscillator by oscillator, as in FireflyBank::step(): later oscillators see
+// the phases the earlier ones have just taken.
+static void firefly(const FireflyLanes& f) {
+	for (int l = 0; l < f.lanes; l++)
+		f.out[l] = 0.f;
+	for (int i = 0; i < 5; i++) {
+		float* theta = &f.theta[i*16];
+		const float* omega = &f.omega[i*16];
+		float ks[16];
+		for (int l = 0; l < f.lanes; l++)
+			ks[l] = omega[l];
+		for (int j = 0; j < 5; j++) {
+			if (j == i)
+				continue;
+			const float* other = &f.theta[j*16];
+			for (int l = 0; l < f.lanes; l++) {
+				int kindex = 50 + 50*((other[l] - theta[l])/f.nt);
+				float coupling = f.Kcurves[kindex]*f.Kt[l];
+				coupling += f.Kcurves[102 + kindex]*(1.f - f.Kt[l]);
+				ks[l] += f.charms[j] * omega[l] * f.K[l] * coupling;
+			}
+		}
+		const int* wave1 = &f.wave1[i*16];
+		const int* wave2 = &f.wave2[i*16];
+		const float* mix = &f.waveMix[i*16];
+		for (int l = 0; l < f.lanes; l++) {
+			float th = theta[l] + ks[l]*f.sampleTime;
+			th = th - __builtin_floorf(th/f.nt)*f.nt;
+			theta[l] = th;
+			int windex = (int) __builtin_floorf(7200*th/f.nt);
+			f.out[l] += f.waves[wave1[l]*7200 + windex]*(1.0f - mix[l])*f.charms[i];
+			f.out[l] += f.waves[wave2[l]*7200 + windex]* mix[l]*f.charms[i];
+		}
+	}
+}
+
+// neighbour mean minus own x, as Rossler::Topology: 0 ring, 1 chain, 2 all to all
+static void diffusion(int lanes, int topology, const float* xs, float* d) {
+	if (topology == 2) {
+		float sum = 0.f;
+		for (int l = 0; l < lanes; l++)
+			sum += xs[l];
+		float mean = sum/lanes;
+		for (int l = 0; l < lanes; l++)
+			d[l] = mean - xs[l];
+		return;
+	}
+	float padded[16 + 2];
+	padded[0] = (topology == 0) ? xs[lanes - 1] : xs[0];
+	for (int l = 0; l < lanes; l++)
+		padded[l + 1] = xs[l];
+	padded[lanes + 1] = (topology == 0) ? xs[0] : xs[lanes - 1];
+	for (int l = 0; l < lanes; l++)
+		d[l] = 0.5f*(padded[l] + padded[l + 2]) - padded[l + 1];
+}
+
+static void rossler(const RosslerLanes& r) {
+	// the fields in locals: stores through x, y and z could otherwise alias r
+	const int n = r.lanes;
+	float* x = r.x;
+	float* y = r.y;
+	float* z = r.z;
+	const float* pert = r.pert;
+	const float a = r.a, b = r.b, c = r.c;
+	const float coupling = r.coupling;
+	const int topology = r.topology;
+	const int stride = r.stride;
+	const bool legacyStep = r.legacyStep;
+	float* traced = r.traced;
+	const bool coupled = n > 1 && coupling != 0.f;
+	float dt[16];
+	int substeps[16];
+	int most = 1;
+	for (int l = 0; l < n; l++) {
+		float pitch = FREQ_C4 * exp2(r.pitch[l])*6.2831853f;
+		dt[l] = r.sampleTime * pitch/2.0f;
+		substeps[l] = 1;
+		r.xPrev[l] = x[l];
+	}
+	if (stride > 1) {
+		for (int l = 0; l < n; l++) {
+			float longest = (dt[l] < r.maxStridedDt) ? r.maxStridedDt : dt[l];
+			substeps[l] = (int) __builtin_ceilf(stride*dt[l]/longest);
+			most = substeps[l] > most ? substeps[l] : most;
+		}
+		// a network steps together, at the finest of its channels' substeps
+		for (int l = 0; l < n; l++) {
+			if (coupled)
+				substeps[l] = most;
+			dt[l] = stride*dt[l]/substeps[l];
+		}
+	}
+
+	float k1x[16], k1y[16], k1z[16];
+	float xp[16], yp[16], zp[16];
+	float d[16];
+	for (int i = 0; i < most; i++) {
+		if (coupled)
+			diffusion(n, topology, x, d);
+		for (int l = 0; l < n; l++) {
+			float xl = x[l], yl = y[l], zl = z[l];
+			k1x[l] = -yl-zl;
+			if (coupled)
+				k1x[l] += coupling*d[l];
+			k1y[l] = xl + a*yl + pert[l];
+			k1z[l] = b + zl*(xl-c);
+			xp[l] = xl + k1x[l] * dt[l];
+			yp[l] = yl + k1y[l] * dt[l];
+			zp[l] = zl + k1z[l] * dt[l];
+		}
+		if (coupled)
+			diffusion(n, topology, xp, d);
+		for (int l = 0; l < n; l++) {
+			float k2x = -yp[l]-zp[l];
+			if (coupled)
+				k2x += coupling*d[l];
+			float k2y = xp[l] + a*yp[l] + pert[l];
+			float k2z = b + zp[l]*(xp[l]-c);
+			// the old doubled Euler step, see Rossler::legacyStep
+			float kx = legacyStep ? k2x : k1x[l];
+			float ky = legacyStep ? k2y : k1y[l];
+			float kz = legacyStep ? k2z : k1z[l];
+			xp[l] = x[l] + (kx + k2x )* dt[l];
+			yp[l] = y[l] + (ky + k2y )* dt[l];
+			zp[l] = z[l] + (kz + k2z )* dt[l];
+		}
+		if (traced) {
+			for (int l = 0; l < n; l++) {
+				if (i == substeps[l] - 1) {
+					traced[l*3] = xp[l];
+					traced[l*3 + 1] = yp[l];
+					traced[l*3 + 2] = zp[l];
+				}
+			}
+		}
+		for (int l = 0; l < n; l++) {
+			bool active = i < substeps[l];
+			x[l] = active ? clampf(xp[l], -20.f, 20.f) : x[l];
+			y[l] = active ? clampf(yp[l], -20.f, 20.f) : y[l];
+			z[l] = active ? clampf(zp[l], -20.f, 20.f) : z[l];
+		}
+	}
+}
+
+extern const Kernels set = {ZC_KERNEL_NAME, normals, warbler, firefly, rossler};
+
+} // namespace ZC_KERNEL_NS
+} // namespace zcdsp
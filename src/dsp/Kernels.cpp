@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+// The baseline kernel set, built with the plugin's own flags, and the choice between sets.
+#if defined(__x86_64__) || defined(__i386__)
+#define ZC_KERNEL_NAME "SSE4.2"
+#else
+#define ZC_KERNEL_NAME "baseline"
+#endif
+#define ZC_KERNEL_NS baseline
+#include "KernelBodies.hpp"
+
+namespace zcdsp {
+
+#if defined(__x86_64__) || defined(__i386__)
+namespace avx2 {
+extern const Kernels set;
+}
+namespace avx512 {
+extern const Kernels set;
+}
+#endif
+
+Kernels kernels = {ZC_KERNEL_NAME, baseline::normals, baseline::warbler, baseline::firefly, baseline::rossler};
+
+int supportedKernels(const Kernels** sets, int max) {
+	int n = 0;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (n < max && __builtin_cpu_supports("avx512f"))
+		sets[n++] = &avx512::set;
+	if (n < max && __builtin_cpu_supports("avx2"))
+		sets[n++] = &avx2::set;
+#endif
+	if (n < max)
+		sets[n++] = &baseline::set;
+	return n;
+}
+
+void selectKernels() {
+	const Kernels* sets[1];
+	if (supportedKernels(sets, 1) > 0)
+		kernels = *sets[0];
+}
+
+} // namespace zcdsp
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include <cstdint>
+
+namespace zcdsp {
+
+// The hottest per-sample loops, written as plain loops over lanes (channels,
+// or oscillators) so the compiler can vectorise them, and compiled once per
+// instruction set: the plugin's baseline (SSE4.2 on x86), AVX2 and AVX-512,
+// each in its own file with its own -m flags. selectKernels(), from the
+// plugin's init(), points `kernels` at the widest set the CPU runs.
+//
+// Every set gives the same bits as the others and as the scalar code the
+// engines had before: the same operations in the same order, no FMA
+// contraction (-ffp-contract=off), no reassociated sums. The bodies only use
+// their own static helpers and compiler builtins, never inline functions from
+// other headers (std::floor included), so no out-of-line copy built for a
+// wider set can stand in for a baseline one at link time.
+
+// Warbler's Hopf oscillators, one lane each, laid out channel*8 + oscillator.
+// The caller has already scanned each channel's detuned pitch (V/oct) and drawn
+// the noise; x, y and indets are updated in place.
+struct WarblerLanes {
+	int lanes;
+	float* x;
+	float* y;
+	float* indets;
+	const float* pitch;
+	const float* rate;  // frequency multiple of the harmonic set
+	const float* kick;  // noise for this sample
+	const float* push;  // gain times external input
+	const float* drift; // detune target
+	float sampleTime;
+};
+
+// Firefly's five phase oscillators for each channel lane; arrays of five rows
+// of 16 lanes, oscillator major.
+struct FireflyLanes {
+	int lanes;
+	float* theta;
+	const float* omega; // angular frequencies
+	const float* K;
+	const float* Kt;
+	const float* charms; // five, shared by every lane
+	const int* wave1;
+	const int* wave2;
+	const float* waveMix;
+	const float* waves;   // 11 tables of 7200
+	const float* Kcurves; // 2 curves of 102
+	float sampleTime;
+	float nt;
+	float* out;
+};
+
+// The Rossler system for each channel lane, as Rossler::step(), or as a
+// network when coupling is nonzero; topology as Rossler::Topology.
+struct RosslerLanes {
+	int lanes;
+	float* x;
+	float* y;
+	float* z;
+	float* xPrev;
+	const float* pitch;
+	const float* pert;
+	float a, b, c;
+	float coupling;
+	int topology;
+	float sampleTime;
+	int stride;
+	float maxStridedDt;
+	float* traced; // x, y and z before clamping, channel major, or null
+	bool legacyStep;
+};
+
+struct Kernels {
+	const char* name;
+	// Ziggurat fast path for n (up to 32) words: out gets each normal, and the
+	// returned bit k is set where word k needs the slow path instead.
+	uint32_t (*normals)(const uint32_t* u, float* out, int n, const uint32_t* kn, const float* wn);
+	void (*warbler)(const WarblerLanes& l);
+	void (*firefly)(const FireflyLanes& l);
+	void (*rossler)(const RosslerLanes& l);
+};
+
+extern Kernels kernels;
+
+// Picks the widest set the CPU supports.
+void selectKernels();
+
+// The sets this build has and the CPU runs, widest first; returns how many.
+int supportedKernels(const Kernels** sets, int max);
+
+} // namespace zcdsp
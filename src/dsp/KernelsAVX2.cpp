@@ -0,0 +1,13 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+// The AVX2 kernel set; built with -mavx2 -ffp-contract=off
+// (see the Makefiles), and chosen only on CPUs that have it.
+#if defined(__x86_64__) || defined(__i386__)
+#ifndef __AVX2__
+#error "build this file with -mavx2"
+#endif
+#define ZC_KERNEL_NAME "AVX2"
+#define ZC_KERNEL_NS avx2
+#include "KernelBodies.hpp"
+#endif
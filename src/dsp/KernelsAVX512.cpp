@@ -0,0 +1,13 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+// The AVX-512 kernel set; built with -mavx512f -mprefer-vector-width=512 -ffp-contract=off
+// (see the Makefiles), and chosen only on CPUs that have it.
+#if defined(__x86_64__) || defined(__i386__)
+#ifndef __AVX512F__
+#error "build this file with -mavx512f"
+#endif
+#define ZC_KERNEL_NAME "AVX-512"
+#define ZC_KERNEL_NS avx512
+#include "KernelBodies.hpp"
+#endif
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include <vector>
+
+namespace zcdsp {
+
+// Finds a periodic orbit in one channel of a three dimensional flow and plays
+// it back from a table. The caller reports each integration step; returns
+// through the Poincare section y = 0 (y rising) are compared with those one
+// to MAX_PERIOD returns earlier. Once they repeat within tolerance for three
+// whole cycles, the next cycle is captured into a table, on a grid in flow
+// time, so playback follows any pitch. If the captured cycle closes on itself,
+// the channel plays the table until reset(); otherwise it keeps watching.
+// After PATIENCE returns with no cycle, as on a chaotic attractor, it rests
+// until reset() and the caller stops reporting steps.
+//
+// Between the two ends of a step the orbit is taken as the cubic with their
+// states and slopes, so the section and the table hold even at high pitch,
+// with few steps to a cycle.
+struct LimitCycle {
+	static const int TABLE_SIZE = 1024;
+	static const int MAX_PERIOD = 6;  // returns per cycle
+	static const int HISTORY = 4*MAX_PERIOD;
+	static const int PATIENCE = 256; // returns, about a second at C4
+	enum State {
+		WATCHING,
+		CAPTURING,
+		PLAYING,
+		RESTING
+	};
+
+	// one integration step: states and slopes (in flow time) at both ends
+	struct Step {
+		float from[3];
+		float fromSlope[3];
+		float to[3];
+		float toSlope[3];
+		float dt;
+
+		// component k a fraction s of the way through
+		float at(int k, float s) const {
+			float s2 = s*s;
+			float s3 = s2*s;
+			return (2.f*s3 - 3.f*s2 + 1.f)*from[k] + (s3 - 2.f*s2 + s)*dt*fromSlope[k]
+				+ (3.f*s2 - 2.f*s3)*to[k] + (s3 - s2)*dt*toSlope[k];
+		}
+
+		// its derivative in s
+		float rate(int k, float s) const {
+			float s2 = s*s;
+			return (6.f*s2 - 6.f*s)*(from[k] - to[k]) + (3.f*s2 - 4.f*s + 1.f)*dt*fromSlope[k]
+				+ (3.f*s2 - 2.f*s)*dt*toSlope[k];
+		}
+	};
+
+	State state = WATCHING;
+	float tolerance = 0.001f; // in x and z at the section, relative to their size
+	// the last returns through the section, newest last, and the flow time before each
+	float returnX[HISTORY];
+	float returnZ[HISTORY];
+	float interval[HISTORY];
+	int returns = 0;
+	float sinceReturn = 0.f;
+	int watched = 0; // returns since reset()
+	// the captured cycle: period returns long, length in flow time, table
+	// entry i at time i*spacing, the first at the section
+	int period = 0;
+	int captured = 0;
+	float spacing = 0.f;
+	float perSpacing = 0.f;
+	float length = 0.f;
+	float lastSlope[3];
+	float elapsed = 0.f; // since the cycle started, capturing or playing
+	int filled = 0;
+	// x, y and z of each entry; apart from the rest, which is read on every step
+	std::vector<float> table;
+
+	LimitCycle() : table(TABLE_SIZE*3) {}
+
+	void reset() {
+		watched = 0;
+		restart();
+	}
+
+	// back to watching after a capture that failed, still counting returns
+	void restart() {
+		state = watched < PATIENCE ? WATCHING : RESTING;
+		returns = 0;
+		sinceReturn = 0.f;
+	}
+
+	bool playing() const {
+		return state == PLAYING;
+	}
+
+	bool resting() const {
+		return state == RESTING;
+	}
+
+	// True when a step with y going from yFrom to yTo only adds up time, as
+	// most do; the caller then calls wait() instead of observe().
+	bool quiet(float yFrom, float yTo) const {
+		return state == WATCHING && !(yFrom < 0.f && yTo >= 0.f);
+	}
+
+	void wait(float dt) {
+		sinceReturn += dt;
+	}
+
+	void observe(const Step& step) {
+		bool crossing = step.from[1] < 0.f && step.to[1] >= 0.f;
+		if (!crossing) {
+			if (state == CAPTURING && !fill(step, elapsed, 1.f)) {
+				restart();
+				return;
+			}
+			elapsed += step.dt;
+			sinceReturn += step.dt;
+			return;
+		}
+
+		// Newton's method on the cubic, from where the chord crosses
+		float s = step.from[1]/(step.from[1] - step.to[1]);
+		for (int i = 0; i < 3; i++) {
+			float rate = step.rate(1, s);
+			if (rate <= 0.f)
+				break;
+			s = clamp(s - step.at(1, s)/rate, 0.f, 1.f);
+		}
+		float sectionX = step.at(0, s);
+		float sectionZ = step.at(2, s);
+
+		if (state == CAPTURING && ++captured == period) {
+			if (!fill(step, elapsed, s) || !near(sectionX, table[0]) || !near(sectionZ, table[2])) {
+				restart();
+				return;
+			}
+			length = elapsed + s*step.dt;
+			// the last entry joins the first, at length
+			float start = (filled - 1)*spacing;
+			for (int k = 0; k < 3; k++)
+				lastSlope[k] = (table[k] - table[(filled - 1)*3 + k])/(length - start);
+			perSpacing = 1.f/spacing;
+			elapsed = (1.f - s)*step.dt;
+			state = PLAYING;
+			return;
+		}
+		if (state == CAPTURING) {
+			if (!fill(step, elapsed, 1.f)) {
+				restart();
+				return;
+			}
+			elapsed += step.dt;
+			return;
+		}
+
+		// watching: keep the return, then look for the shortest repeat
+		if (returns == HISTORY) {
+			std::copy(returnX + 1, returnX + HISTORY, returnX);
+			std::copy(returnZ + 1, returnZ + HISTORY, returnZ);
+			std::copy(interval + 1, interval + HISTORY, interval);
+			returns--;
+		}
+		returnX[returns] = sectionX;
+		returnZ[returns] = sectionZ;
+		interval[returns] = sinceReturn + s*step.dt;
+		returns++;
+		sinceReturn = (1.f - s)*step.dt;
+		watched++;
+		period = repeat();
+		if (period == 0) {
+			if (watched >= PATIENCE)
+				state = RESTING;
+			return;
+		}
+		float estimate = 0.f;
+		for (int j = 0; j < period; j++)
+			estimate += interval[returns - 1 - j];
+		// some room for a cycle a little longer than the last
+		spacing = estimate/(TABLE_SIZE - TABLE_SIZE/32);
+		// the cycle starts at the section, s*dt into this step
+		elapsed = -s*step.dt;
+		filled = 0;
+		captured = 0;
+		state = CAPTURING;
+		if (!fill(step, elapsed, 1.f)) {
+			restart();
+			return;
+		}
+		elapsed += step.dt;
+	}
+
+	// Advances playback by dt in flow time and gives x there.
+	float play(float dt) {
+		elapsed += dt;
+		if (elapsed >= length)
+			elapsed = std::fmod(elapsed, length);
+		float position = elapsed*perSpacing;
+		int i = (int) position;
+		if (i + 1 < filled)
+			return table[i*3] + (position - i)*(table[(i + 1)*3] - table[i*3]);
+		return table[(filled - 1)*3] + (elapsed - (filled - 1)*spacing)*lastSlope[0];
+	}
+
+	// x, y and z at the playback position, to trace or carry on integrating from
+	void sample(float* out) const {
+		float position = elapsed*perSpacing;
+		int i = std::min((int) position, filled - 1);
+		for (int k = 0; k < 3; k++) {
+			if (i + 1 < filled)
+				out[k] = table[i*3 + k] + (position - i)*(table[(i + 1)*3 + k] - table[i*3 + k]);
+			else
+				out[k] = table[i*3 + k] + (elapsed - i*spacing)*lastSlope[k];
+		}
+	}
+
+	bool near(float a, float b) const {
+		return std::fabs(a - b) < tolerance*(1.f + std::fabs(a));
+	}
+
+	// returns per cycle of the shortest period seen repeating, or 0
+	int repeat() const {
+		for (int p = 1; p <= MAX_PERIOD; p++) {
+			if (returns < 4*p)
+				return 0;
+			bool same = true;
+			for (int j = 0; j < 3*p && same; j++) {
+				int n = returns - 1 - j;
+				same = near(returnX[n], returnX[n - p]) && near(returnZ[n], returnZ[n - p]);
+			}
+			if (same)
+				return p;
+		}
+		return 0;
+	}
+
+	// Table entries from the step starting at time t0 of the cycle, up to a
+	// fraction end of it; false when the cycle runs past the table.
+	bool fill(const Step& step, float t0, float end) {
+		float t1 = t0 + end*step.dt;
+		while (filled*spacing < t1) {
+			if (filled == TABLE_SIZE)
+				return false;
+			float s = (filled*spacing - t0)/step.dt;
+			for (int k = 0; k < 3; k++)
+				table[filled*3 + k] = step.at(k, s);
+			filled++;
+		}
+		return true;
+	}
+};
+
+} // namespace zcdsp
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include "Random.hpp"
+#include "Variants.hpp"
+
+namespace zcdsp {
+
+// Up to 16 Ornstein-Uhlenbeck processes dx = spring (mean - x) dt + noise dW,
+// integrated with Euler-Maruyama. Triggers reset channels to the mean.
+struct OUProcess {
+	struct Controls {
+		float noise = 0.f;
+		float spring = 0.f;
+		float mean = 1.f;
+	};
+	// per-channel CV, added to the controls (noise at 1/10 scale); a variant
+	// reads only the inputs its mask names, catchUp() reads all that are set
+	struct CV {
+		const float* noise = nullptr;
+		const float* spring = nullptr;
+		const float* mean = nullptr;
+	};
+	enum CVBits {
+		NOISE_CV = 1 << 0,
+		SPRING_CV = 1 << 1,
+		MEAN_CV = 1 << 2,
+		NUM_CV = 3
+	};
+	typedef void (OUProcess::*ProcessFn)(int, const Controls&, const CV&, uint32_t, float*);
+
+	float outsignal[16] = {0};
+	zcrandom::Stream rng;
+	float sampleTime = 1.f/44100.f;
+	float sqrtdelta = 1.0/std::sqrt(44100.f);
+	// samples skipped while nothing listens, and channels triggered meanwhile
+	int idleSamples = 0;
+	uint32_t idleResets = 0;
+	// with zero noise, channels whose last step left them where they were
+	uint32_t settled = 0;
+	float settledMean = 0.f;
+	float settledSpring = 0.f;
+
+	OUProcess(uint64_t seed = 0) : rng(seed) {}
+
+	void setSampleRate(float sampleRate) {
+		sampleTime = 1.f/sampleRate;
+		sqrtdelta = 1.0/std::sqrt(sampleRate);
+	}
+
+	// Counts a skipped sample; catchUp() covers them all at once.
+	void idle(uint32_t triggered) {
+		idleSamples++;
+		idleResets |= triggered;
+	}
+
+	// Advances every channel over the idle samples in one step, using the exact
+	// OU transition for the current parameters, so the signal has the right
+	// distribution when a cable is patched again.
+	void catchUp(int channels, const Controls& k, const CV& cv) {
+		float t = idleSamples*sampleTime;
+		float noiseDraws[16];
+		rng.normals(noiseDraws, channels);
+		for (int c = 0; c < channels; c++) {
+			float noise = k.noise + voltage(cv.noise, c)/10.0f;
+			float spring = k.spring + voltage(cv.spring, c);
+			float mean = k.mean + voltage(cv.mean, c);
+			if ((idleResets >> c) & 1){
+				outsignal[c] = mean;
+				continue;
+			}
+			float decay = std::exp(-spring*t);
+			float variance = (std::abs(spring) > 1e-4f) ? noise*noise*(1.f - decay*decay)/(2.f*spring) : noise*noise*t;
+			outsignal[c] = mean + (outsignal[c] - mean)*decay + std::sqrt(std::max(variance, 0.f))*noiseDraws[c];
+		}
+		idleSamples = 0;
+		idleResets = 0;
+	}
+
+	// True when every channel has settled and nothing would move it: the
+	// outputs can be held without stepping.
+	bool holding(int channels, const Controls& k, uint32_t triggered) const {
+		uint32_t channelMask = (uint32_t) ((1ull << channels) - 1);
+		return (settled & channelMask) == channelMask && !triggered && k.noise == 0.f
+			&& k.mean == settledMean && k.spring == settledSpring;
+	}
+
+	static const VariantTable<OUProcess, ProcessFn, 1 << NUM_CV>& variants() {
+		static const VariantTable<OUProcess, ProcessFn, 1 << NUM_CV> table;
+		return table;
+	}
+
+	// One sample for the CV inputs in Mask; out gets each channel's value.
+	template <uint32_t Mask>
+	void processVariant(int channels, const Controls& k, const CV& cv, uint32_t triggered, float* out) {
+		const bool noiseCV = Mask & NOISE_CV;
+		const bool springCV = Mask & SPRING_CV;
+		const bool meanCV = Mask & MEAN_CV;
+		float noiseDraws[16];
+		rng.normals(noiseDraws, channels);
+		// per-sample step sizes, when no CV makes them per channel
+		const float noiseStep = sqrtdelta*k.noise;
+		const float springStep = k.spring*sampleTime;
+		// only with no noise and the same mean and spring for every channel
+		const bool canSettle = !noiseCV && !meanCV && !springCV && k.noise == 0.f;
+		for (int c = 0; c < channels; c++) {
+			float mean = meanCV ? k.mean + cv.mean[c] : k.mean;
+
+			if ((triggered >> c) & 1){
+				outsignal[c] = mean;
+			}
+
+			float previous = outsignal[c];
+			float r = noiseDraws[c];
+			if (noiseCV)
+				outsignal[c] += sqrtdelta*r*(k.noise + cv.noise[c]/10.0f);
+			else
+				outsignal[c] += noiseStep*r;
+			if (springCV)
+				outsignal[c] += (k.spring + cv.spring[c])*(mean-outsignal[c])*sampleTime;
+			else
+				outsignal[c] += springStep*(mean-outsignal[c]);
+			// the approach to the mean stalls once the step rounds to zero
+			if (canSettle && outsignal[c] == previous && !((triggered >> c) & 1))
+				settled |= 1u << c;
+			else
+				settled &= ~(1u << c);
+			out[c] = outsignal[c];
+		}
+		settledMean = k.mean;
+		settledSpring = k.spring;
+	}
+
+	// Runs frames samples of channels channels at fixed controls with no CV or
+	// triggers; out is frame major.
+	void process(int frames, int channels, const Controls& k, float* out) {
+		for (int i = 0; i < frames; i++) {
+			float* frame = &out[i*channels];
+			if (holding(channels, k, 0)) {
+				for (int c = 0; c < channels; c++)
+					frame[c] = outsignal[c];
+			}
+			else {
+				processVariant<0>(channels, k, CV(), 0, frame);
+			}
+		}
+	}
+};
+
+} // namespace zcdsp
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#include "Random.hpp"
+
+namespace zcrandom {
+
+uint32_t kn[128];
+float wn[128];
+float fn[128];
+
+// Layer boundaries for the 128 rectangle ziggurat, as in Marsaglia & Tsang (2000).
+// kn and wn are scaled for the 32 bit signed abscissa used by Stream::normal().
+void init() {
+	const double m1 = 2147483648.0;
+	const double vn = 9.91256303526217e-3;
+	double dn = 3.442619855899;
+	double tn = dn;
+	double q = vn/std::exp(-0.5*dn*dn);
+
+	kn[0] = (uint32_t) ((dn/q)*m1);
+	kn[1] = 0;
+	wn[0] = (float) (q/m1);
+	wn[127] = (float) (dn/m1);
+	fn[0] = 1.f;
+	fn[127] = (float) std::exp(-0.5*dn*dn);
+	for (int i = 126; i >= 1; i--) {
+		dn = std::sqrt(-2.0*std::log(vn/dn + std::exp(-0.5*dn*dn)));
+		kn[i + 1] = (uint32_t) ((dn/tn)*m1);
+		tn = dn;
+		fn[i] = (float) std::exp(-0.5*dn*dn);
+		wn[i] = (float) (dn/m1);
+	}
+}
+
+} // namespace zcrandom
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include "Kernels.hpp"
+#include <cmath>
+#include <cstdint>
+
+// Per-instance random streams for the noise-driven modules.
+// Four xoshiro128+ generators run side by side in one SSE register, so each
+// step yields four 32 bit words; uniforms are converted four at a time and
+// normals come from a 128 layer ziggurat (Marsaglia & Tsang), which accepts
+// about 98.8% of draws with one table compare and one multiply.
+namespace zcrandom {
+
+namespace simd = rack::simd;
+
+// Ziggurat tables, filled once by init() from the plugin's init().
+extern uint32_t kn[128];
+extern float wn[128];
+extern float fn[128];
+void init();
+
+struct Xoshiro128Plus4 {
+	__m128i s0, s1, s2, s3;
+
+	void seed(uint64_t seed) {
+		// splitmix64 spreads the seed over the 16 state words; no lane can start all zero
+		uint32_t words[16];
+		for (int i = 0; i < 16; i += 2) {
+			seed += 0x9e3779b97f4a7c15ull;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27))*0x94d049bb133111ebull;
+			z = z ^ (z >> 31);
+			words[i] = (uint32_t) z;
+			words[i + 1] = (uint32_t) (z >> 32);
+		}
+		s0 = _mm_loadu_si128((const __m128i*) &words[0]);
+		s1 = _mm_loadu_si128((const __m128i*) &words[4]);
+		s2 = _mm_loadu_si128((const __m128i*) &words[8]);
+		s3 = _mm_loadu_si128((const __m128i*) &words[12]);
+	}
+
+	__m128i next() {
+		__m128i result = _mm_add_epi32(s0, s3);
+		__m128i t = _mm_slli_epi32(s1, 9);
+		s2 = _mm_xor_si128(s2, s0);
+		s3 = _mm_xor_si128(s3, s1);
+		s1 = _mm_xor_si128(s1, s2);
+		s0 = _mm_xor_si128(s0, s3);
+		s2 = _mm_xor_si128(s2, t);
+		s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+		return result;
+	}
+};
+
+struct Stream {
+	Xoshiro128Plus4 gen;
+	uint32_t words[4];
+	int wordsLeft = 0;
+
+	Stream(uint64_t seed = 0) {
+		reseed(seed);
+	}
+
+	void reseed(uint64_t seed) {
+		gen.seed(seed);
+		wordsLeft = 0;
+	}
+
+	uint32_t u32() {
+		if (wordsLeft == 0) {
+			_mm_storeu_si128((__m128i*) words, gen.next());
+			wordsLeft = 4;
+		}
+		return words[--wordsLeft];
+	}
+
+	// Uniform on [0, 1), 24 bits; the top bits of xoshiro128+ are its strongest.
+	float uniform() {
+		return (u32() >> 8)*(1.f/16777216.f);
+	}
+
+	simd::float_4 uniform4() {
+		__m128i bits = _mm_srli_epi32(gen.next(), 8);
+		return simd::float_4(_mm_cvtepi32_ps(bits))*(1.f/16777216.f);
+	}
+
+	static uint32_t magnitude(int32_t hz) {
+		return hz < 0 ? 0u - (uint32_t) hz : (uint32_t) hz;
+	}
+
+	// Standard normal from one 32 bit word: the layer index comes from the top
+	// seven bits and the signed abscissa from the rest.
+	float normal(uint32_t u) {
+		int iz = u >> 25;
+		int32_t hz = (int32_t) (u << 7);
+		if (magnitude(hz) < kn[iz])
+			return hz*wn[iz];
+		return normalTail(hz, iz);
+	}
+
+	float normal() {
+		return normal(u32());
+	}
+
+	// Fills out[0..n) with standard normals, four words per generator step.
+	// Up to 16 words are drawn ahead and converted together by the kernels;
+	// where a block of four needs the slow path, the generator goes back to
+	// just after that block, so the stream is the same as converting each
+	// block as it is drawn.
+	void normals(float* out, int n) {
+		int i = 0;
+		while (i + 4 <= n) {
+			int blocks = std::min((n - i)/4, 4);
+			uint32_t u[16];
+			Xoshiro128Plus4 after[4];
+			for (int b = 0; b < blocks; b++) {
+				_mm_storeu_si128((__m128i*) &u[4*b], gen.next());
+				after[b] = gen;
+			}
+			uint32_t slow = zcdsp::kernels.normals(u, &out[i], 4*blocks, kn, wn);
+			if (slow) {
+				int b = __builtin_ctz(slow)/4;
+				gen = after[b];
+				for (int k = 4*b; k < 4*b + 4; k++) {
+					if ((slow >> k) & 1)
+						out[i + k] = normalTail((int32_t) (u[k] << 7), u[k] >> 25);
+				}
+				blocks = b + 1;
+			}
+			i += 4*blocks;
+		}
+		for (; i < n; i++)
+			out[i] = normal();
+	}
+
+	simd::float_4 normal4() {
+		float out[4];
+		normals(out, 4);
+		return simd::float_4::load(out);
+	}
+
+	// Rejection path for the ~1.2% of draws outside the rectangles, including the tail beyond r.
+	float normalTail(int32_t hz, int iz) {
+		const float r = 3.442620f;
+		for (;;) {
+			float x = hz*wn[iz];
+			if (iz == 0) {
+				float y;
+				do {
+					x = -std::log(1.f - uniform())/r;
+					y = -std::log(1.f - uniform());
+				} while (y + y < x*x);
+				return hz > 0 ? r + x : -r - x;
+			}
+			if (fn[iz] + uniform()*(fn[iz - 1] - fn[iz]) < std::exp(-0.5f*x*x))
+				return x;
+			uint32_t u = u32();
+			iz = u >> 25;
+			hz = (int32_t) (u << 7);
+			if (magnitude(hz) < kn[iz])
+				return hz*wn[iz];
+		}
+	}
+};
+
+} // namespace zcrandom
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include "Random.hpp"
+
+namespace zcdsp {
+
+// Up to 16 Markov chains on the ring A-B-C-D, each state stepping back or
+// forward one place. Per trigger, or in continuous time with exponential
+// holding times. With a shared chain one draw moves every channel.
+//
+// The transition controls come from the caller as a functor
+// controls(c, index, Pback, Pforward), giving channel c's backward and
+// forward values out of state index (0 to 3), each in [0,1].
+struct RingChain {
+	int8_t state[16] = {0}; //0=A, 1=B, 2=C, 3=D
+	float stateLanes[16] = {0}; // state as floats, for the vectorised routing
+	zcrandom::Stream rng;
+	bool sharedChain = false;
+
+	// Continuous-time mode: the controls set jump rates (full scale = rateScale Hz) and each
+	// channel draws its holding time and next state once, on entering a state.
+	bool continuousTime = false;
+	float rateScale = 10.f;
+	float sampleRate = 44100.f;
+	int64_t sampleCount = 0;
+	int64_t deadline[16] = {0};
+	int64_t enteredAt[16] = {0};
+	int64_t nextDeadline = 0;
+	int8_t nextIndex[16] = {0};
+	int armedChannels = 0;
+	bool armedShared = false;
+
+	RingChain(uint64_t seed = 0) : rng(seed) {}
+
+	void setSampleRate(float sampleRate) {
+		this->sampleRate = sampleRate;
+	}
+
+	// Per-trigger probabilities from the controls: scaled down together when they add up past 1.
+	static void normalise(float& Pback, float& Pforward) {
+		float Pfb = std::max(Pback + Pforward,1.f);
+		Pback = Pback/Pfb;
+		Pforward = Pforward/Pfb;
+	}
+
+	// Per-trigger transition matrix, or in continuous-time mode the per-sample one, I + Q/sampleRate.
+	template <typename Controls>
+	void transitionMatrix(int c, float P[4][4], Controls controls) {
+		for (int i = 0; i < 4; i++) {
+			float Pback, Pforward;
+			controls(c, i, Pback, Pforward);
+			if (continuousTime){
+				Pback *= rateScale/sampleRate;
+				Pforward *= rateScale/sampleRate;
+			} else {
+				normalise(Pback, Pforward);
+			}
+			for (int j = 0; j < 4; j++)
+				P[i][j] = 0.f;
+			P[i][(i + 3) % 4] = Pback;
+			P[i][(i + 1) % 4] = Pforward;
+			P[i][i] = 1.f - Pback - Pforward;
+		}
+	}
+
+	// Draws the next state of channel c from state index (0 to 3).
+	template <typename Controls>
+	int step(int c, int index, Controls controls) {
+		float Pback, Pforward;
+		controls(c, index, Pback, Pforward);
+		normalise(Pback, Pforward);
+		float Tr = rng.uniform();
+		if (Tr < Pforward){
+			return (index + 1) & 3;
+		} else if (Tr < (Pforward+Pback)){
+			return (index + 3) & 3;
+		}
+		return index;
+	}
+
+	// Draws how long channel c stays in its current state and where it goes next.
+	// One uniform picks the direction and, rescaled, gives the exponential holding time.
+	template <typename Controls>
+	void armHold(int c, Controls controls) {
+		int index = state[c];
+		float Pback, Pforward;
+		controls(c, index, Pback, Pforward);
+		float rate = (Pback + Pforward)*rateScale;
+		enteredAt[c] = sampleCount;
+		if (rate <= 0.f){
+			// nothing can happen; look at the controls again in 10ms
+			nextIndex[c] = (int8_t) index;
+			deadline[c] = sampleCount + std::max((int64_t) (0.01f*sampleRate), (int64_t) 1);
+			return;
+		}
+		float pf = Pforward/(Pback + Pforward);
+		float u = rng.uniform();
+		if (u < pf){
+			nextIndex[c] = (int8_t) ((index + 1) & 3);
+			u = u/pf;
+		} else {
+			nextIndex[c] = (int8_t) ((index + 3) & 3);
+			u = (u - pf)/(1.f - pf);
+		}
+		float hold = -std::log(std::max(1.f - u, 1e-12f))/rate*sampleRate;
+		deadline[c] = sampleCount + std::max((int64_t) hold, (int64_t) 1);
+	}
+
+	void updateNextDeadline() {
+		int n = sharedChain ? 1 : armedChannels;
+		nextDeadline = INT64_MAX;
+		for (int c = 0; c < n; c++)
+			nextDeadline = std::min(nextDeadline, deadline[c]);
+	}
+
+	// Channels whose holding time ran out this sample; a single compare while nothing is due.
+	template <typename Controls>
+	uint32_t expiredHolds(int channels, Controls controls) {
+		sampleCount++;
+		if (channels != armedChannels || sharedChain != armedShared){
+			for (int c = 0; c < channels; c++)
+				armHold(c, controls);
+			armedChannels = channels;
+			armedShared = sharedChain;
+			updateNextDeadline();
+		}
+		if (sampleCount < nextDeadline)
+			return 0;
+		uint32_t mask = 0;
+		int n = sharedChain ? 1 : channels;
+		for (int c = 0; c < n; c++)
+			if (deadline[c] <= sampleCount)
+				mask |= 1u << c;
+		return mask;
+	}
+
+	void setState(int c, int index) {
+		state[c] = (int8_t) index;
+		stateLanes[c] = (float) index;
+	}
+};
+
+} // namespace zcdsp
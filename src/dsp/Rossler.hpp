@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include "FastMath.hpp"
+#include "Kernels.hpp"
+#include "LimitCycle.hpp"
+
+namespace zcdsp {
+
+// The Rossler system x' = -y - z, y' = x + a y + e, z' = b + z (x - c) for up
+// to 16 channels, integrated with Heun's method at a speed set by V/oct pitch
+// and clamped to +-20. e is an external perturbation of y.
+//
+// With coupling, the channels form a network: x' gains coupling times the
+// difference between the mean x of a channel's neighbours and its own, taken
+// at each stage of the same Heun step.
+//
+// With the cycle cache on, an uncoupled channel that settles onto a periodic
+// orbit plays it from a table (see LimitCycle) instead of integrating, until
+// a, b or c change or its perturbation is nonzero.
+struct Rossler {
+	struct Controls {
+		float a = 0.2f;
+		float b = 0.2f;
+		float c = 5.7f;
+		float coupling = 0.f;
+	};
+	enum Topology {
+		RING,       // channel c between c-1 and c+1, the last next to the first
+		CHAIN,      // the same with open ends
+		ALL_TO_ALL, // every channel pulled towards the mean of all
+		NUM_TOPOLOGIES
+	};
+
+	float x[16];
+	float y[16];
+	float z[16];
+	// patches from before Heun's method was fixed ran a doubled Euler step
+	bool legacyStep = false;
+	float sampleTime = 1.f/44100.f;
+	// A stride above 1 integrates only every stride-th frame, with a step that
+	// much longer; output() interpolates between the last two steps, a stride late.
+	int stride = 1;
+	int phase = 0;
+	float maxStridedDt = 0.02f;
+	float xPrev[16];
+	Topology topology = RING;
+	// y and z of a channel playing its cycle are only brought up to date when it
+	// goes back to integrating
+	bool cycleCache = false;
+	LimitCycle cycles[16];
+	Controls cycleControls; // the controls the cycles belong to
+	bool cyclesLive = false;
+	int restingChannels = 0; // set when all of them rest, until one is reset
+	float cyclePitch[16];
+	float cycleDt[16];
+
+	Rossler() {
+		reset();
+	}
+
+	// Starts a frame; true when the channels step on this one.
+	bool beginFrame() {
+		if (++phase >= stride) {
+			phase = 0;
+			return true;
+		}
+		return false;
+	}
+
+	float output(int ch) const {
+		if (stride == 1)
+			return x[ch];
+		return xPrev[ch] + (x[ch] - xPrev[ch])*phase/stride;
+	}
+
+	void setSampleRate(float sampleRate) {
+		sampleTime = 1.f/sampleRate;
+	}
+
+	void reset() {
+		for (int c = 0; c < 16; c++) {
+			x[c] = 0.f;
+			y[c] = 5.f;
+			z[c] = 0.f;
+			xPrev[c] = 0.f;
+			cycles[c].reset();
+			cyclePitch[c] = NAN;
+		}
+		restingChannels = 0;
+	}
+
+	static void slope(float x, float y, float z, float a, float b, float c, float pert, float* output) {
+		output[0] = -y-z;
+		output[1] = x + a*y + pert;
+		output[2] = b + z*(x-c);
+	}
+
+	// One Heun step of channel ch, before clamping.
+	void heun(int ch, const Controls& k, float pert, float dt) {
+		float k1[3];
+		slope(x[ch], y[ch], z[ch], k.a, k.b, k.c, pert, k1);
+		float k2[3];
+		slope(x[ch] + k1[0] * dt, y[ch] + k1[1] * dt, z[ch] + k1[2] * dt, k.a, k.b, k.c, pert, k2);
+		if (!legacyStep)
+		{
+			x[ch] += (k1[0] + k2[0] )* dt;
+			y[ch] += (k1[1] + k2[1] )* dt;
+			z[ch] += (k1[2] + k2[2] )* dt;
+		} else // old behavior where the k and k2 pointers were both pointing to the same array
+		{
+			x[ch] += (k2[0] + k2[0] )* dt;
+			y[ch] += (k2[1] + k2[1] )* dt;
+			z[ch] += (k2[2] + k2[2] )* dt;
+		}
+	}
+
+	// Advances channel ch by one sample, or by stride samples. traced, when
+	// given, gets x, y and z before clamping.
+	void step(int ch, const Controls& k, float pitch, float pert, float* traced = nullptr) {
+		pitch = FREQ_C4 * fastmath::exp2(pitch)*6.2831853f;
+		float dt = sampleTime * pitch/2.0f;
+		xPrev[ch] = x[ch];
+		int substeps = 1;
+		if (stride > 1) {
+			// the strided step grows only as far as the attractor survives it,
+			// which at high pitch is not far; beyond that it is split up again
+			float longest = std::max(dt, maxStridedDt);
+			substeps = (int) std::ceil(stride*dt/longest);
+			dt = stride*dt/substeps;
+		}
+		for (int i = 0; i < substeps; i++) {
+			heun(ch, k, pert, dt);
+			if (traced && i == substeps - 1) {
+				traced[0] = x[ch];
+				traced[1] = y[ch];
+				traced[2] = z[ch];
+			}
+			x[ch] = clamp(x[ch],-20.f,20.f);
+			y[ch] = clamp(y[ch],-20.f,20.f);
+			z[ch] = clamp(z[ch],-20.f,20.f);
+		}
+	}
+
+	// Advances all channels by one sample, or by stride samples, through the
+	// kernels. Uncoupled, each channel comes out as from step(); with coupling,
+	// they step together as a network, the neighbour terms taken at both
+	// stages of the same Heun step. pitch and pert hold each channel's V/oct
+	// and perturbation; traced, when given, gets x, y and z of every channel
+	// before clamping, channel major. With the cycle cache on and no coupling,
+	// see stepCached().
+	void stepAll(int channels, const Controls& k, const float* pitch, const float* pert, float* traced = nullptr) {
+		bool coupled = channels > 1 && k.coupling != 0.f;
+		if (cycleCache && !coupled) {
+			stepCached(channels, k, pitch, pert, traced);
+			return;
+		}
+		if (cyclesLive) {
+			for (int c = 0; c < 16; c++)
+				leaveCycle(c);
+			cyclesLive = false;
+		}
+		RosslerLanes r = {channels, x, y, z, xPrev, pitch, pert, k.a, k.b, k.c, k.coupling, topology,
+			sampleTime, stride, maxStridedDt, traced, legacyStep};
+		kernels.rossler(r);
+	}
+
+	// Back to integrating channel c, from where its cycle was.
+	void leaveCycle(int c) {
+		if (cycles[c].playing()) {
+			float s[3];
+			cycles[c].sample(s);
+			x[c] = s[0];
+			y[c] = s[1];
+			z[c] = s[2];
+		}
+		cycles[c].reset();
+		restingChannels = 0;
+	}
+
+	// x, y and z of every channel, with those playing a cycle at their place on
+	// it rather than where they left off integrating.
+	void settledState(float* xs, float* ys, float* zs) const {
+		for (int c = 0; c < 16; c++) {
+			float s[3] = {x[c], y[c], z[c]};
+			if (cycles[c].playing())
+				cycles[c].sample(s);
+			xs[c] = s[0];
+			ys[c] = s[1];
+			zs[c] = s[2];
+		}
+	}
+
+	// Drops the cycles without touching x, y and z, as after loading them.
+	void forgetCycles() {
+		for (int c = 0; c < 16; c++)
+			cycles[c].reset();
+		cyclesLive = false;
+		restingChannels = 0;
+	}
+
+	// stepAll() with the cycle cache: channels with a cycle play it, the rest
+	// integrate and are watched for one until their LimitCycle rests. The
+	// kernels step every channel whenever any integrates, as the lanes cost no
+	// more; the playing ones then take back their x and carry on along the
+	// table. With none watched or playing it is plain integration, and once
+	// all rest, the only check is for a perturbation to wake them.
+	void stepCached(int channels, const Controls& k, const float* pitch, const float* pert, float* traced) {
+		if (!cyclesLive || k.a != cycleControls.a || k.b != cycleControls.b || k.c != cycleControls.c) {
+			for (int c = 0; c < 16; c++)
+				leaveCycle(c);
+			cycleControls = k;
+			cyclesLive = true;
+		}
+		RosslerLanes r = {channels, x, y, z, xPrev, pitch, pert, k.a, k.b, k.c, k.coupling, topology,
+			sampleTime, stride, maxStridedDt, traced, legacyStep};
+		if (channels == restingChannels) {
+			int c = 0;
+			while (c < channels && pert[c] == 0.f)
+				c++;
+			if (c == channels) {
+				kernels.rossler(r);
+				return;
+			}
+		}
+		bool playing[16];
+		bool watched[16];
+		int integrating = 0;
+		int watching = 0;
+		int resting = 0;
+		for (int c = 0; c < channels; c++) {
+			if (pitch[c] != cyclePitch[c]) {
+				// flow time of one step: the kernels' dt, whose Heun step adds
+				// both slopes unhalved, twice over
+				cyclePitch[c] = pitch[c];
+				cycleDt[c] = sampleTime * FREQ_C4 * fastmath::exp2(pitch[c])*6.2831853f;
+			}
+			if (pert[c] != 0.f)
+				leaveCycle(c);
+			playing[c] = cycles[c].playing();
+			watched[c] = !playing[c] && pert[c] == 0.f && !cycles[c].resting();
+			integrating += !playing[c];
+			watching += watched[c];
+			resting += cycles[c].resting();
+		}
+
+		if (integrating == channels && watching == 0) {
+			if (resting == channels)
+				restingChannels = channels;
+			kernels.rossler(r);
+			return;
+		}
+		if (integrating > 0) {
+			float before[16][3];
+			for (int c = 0; c < channels; c++) {
+				before[c][0] = x[c];
+				before[c][1] = y[c];
+				before[c][2] = z[c];
+			}
+			kernels.rossler(r);
+			for (int c = 0; c < channels; c++) {
+				if (playing[c]) {
+					// back to the cycle's last sample, which playback moves on from
+					x[c] = before[c][0];
+					continue;
+				}
+				if (!watched[c])
+					continue;
+				float dt = stride*cycleDt[c];
+				if (cycles[c].quiet(before[c][1], y[c])) {
+					cycles[c].wait(dt);
+					continue;
+				}
+				LimitCycle::Step step;
+				for (int i = 0; i < 3; i++)
+					step.from[i] = before[c][i];
+				step.to[0] = x[c];
+				step.to[1] = y[c];
+				step.to[2] = z[c];
+				slope(step.from[0], step.from[1], step.from[2], k.a, k.b, k.c, 0.f, step.fromSlope);
+				slope(step.to[0], step.to[1], step.to[2], k.a, k.b, k.c, 0.f, step.toSlope);
+				step.dt = dt;
+				cycles[c].observe(step);
+			}
+		}
+
+		for (int c = 0; c < channels; c++) {
+			if (!playing[c])
+				continue;
+			xPrev[c] = x[c];
+			x[c] = cycles[c].play(stride*cycleDt[c]);
+			if (traced) {
+				cycles[c].sample(&traced[c*3]);
+				x[c] = traced[c*3];
+			}
+		}
+	}
+
+	// Runs frames samples of channels channels at fixed controls and pitch
+	// (V/oct) with no perturbation; xOut gets x, frame major.
+	void process(int frames, int channels, const Controls& k, float pitch, float* xOut) {
+		float pitches[16];
+		float pert[16] = {};
+		for (int ch = 0; ch < channels; ch++)
+			pitches[ch] = pitch;
+		for (int i = 0; i < frames; i++) {
+			stepAll(channels, k, pitches, pert);
+			for (int ch = 0; ch < channels; ch++)
+				xOut[i*channels + ch] = x[ch];
+		}
+	}
+};
+
+} // namespace zcdsp
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include <cstdint>
+#include <type_traits>
+
+// Table of M::processVariant<Mask> for every mask below Count, so a module can
+// switch to the variant for its current connections with one indirect call.
+// Inside a variant, terms for unpatched inputs are compile-time zero and drop out.
+template <typename M, typename Fn, uint32_t Count>
+struct VariantTable {
+	Fn table[Count];
+
+	VariantTable() {
+		fill<0>();
+	}
+
+	const Fn& operator[](uint32_t mask) const {
+		return table[mask];
+	}
+
+private:
+	template <uint32_t Mask>
+	typename std::enable_if<(Mask < Count)>::type fill() {
+		table[Mask] = &M::template processVariant<Mask>;
+		fill<Mask + 1>();
+	}
+
+	template <uint32_t Mask>
+	typename std::enable_if<(Mask == Count)>::type fill() {}
+};
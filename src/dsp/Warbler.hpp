@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+#include "Common.hpp"
+#include "FastMath.hpp"
+#include "Random.hpp"
+#include "Kernels.hpp"
+
+namespace zcdsp {
+
+// Eight noisy Hopf oscillators per channel, up to 16 channels, tuned to a
+// harmonic set and slowly detuned by their own noise. An external signal
+// pushes on x.
+struct WarblerBank {
+	struct Controls {
+		float noise = 0.01f;
+		float detune = 0.00001f;
+		float gain = 1.f;
+		int harmonics = 10;
+	};
+
+	zcrandom::Stream rng;
+	float xint[128];
+	float yint[128];
+	float indets[128];
+	float sampleTime = 1.f/44100.f;
+	float sqrtdelta = 1.0f/std::sqrt(44100.f);
+	// oscillators stepped per channel: all 8, or every 2nd, 4th or 8th of them
+	// with the sum scaled up to match; the others hold where they are
+	int active = 8;
+	float dets[8] = {0,-1,2,-3,4,-5,6,-7};
+	//float dets[8] = {0.000929f,0.000377f,0.000076f,0.0f,0.000081f,0.000108f,0.000153f,0.000487f};
+	float mults[168] = {
+		0.03125, 0.0625,0.125,0.25,0.5, 0.5, 1.0, 1.0,
+		0.0625,  0.125, 0.25, 0.25,0.5, 0.5, 1.0, 1.0,
+		0.125,   0.25,  0.25, 0.5, 0.5, 0.5, 1.0, 1.0,
+		0.125,   0.25,  0.25, 0.5, 0.5, 1.0, 1.0, 1.0,
+		0.25,    0.25,  0.5,  0.5, 1.0, 1.0, 1.0, 1.0,
+		0.25,    0.5,   0.5,  0.5, 1.0, 1.0, 1.0, 2.0,
+		0.25,    0.5,   0.5,  1.0, 1.0, 1.0, 1.0, 2.0,
+		0.25,    0.5,   0.5,  1.0, 1.0, 1.0, 2.0, 2.0,
+		0.25,    0.5,   1.0,  1.0, 1.0, 1.0, 1.0, 2.0,
+		0.50,    0.5,   1.0,  1.0, 1.0, 1.0, 1.0, 2.0,
+		1.00,    1.0,   1.0,  1.0, 1.0, 1.0, 1.0, 1.0,
+		1.00,    1.0,   1.0,  1.0, 1.0, 1.0, 1.0, 2.0,
+		0.50,    1.0,   1.0,  1.0, 1.0, 1.0, 2.0, 2.0,
+		0.50,    1.0,   1.0,  1.0, 1.0, 2.0, 2.0, 2.0,
+		0.50,    1.0,   1.0,  1.0, 2.0, 2.0, 2.0, 3.0,
+		// 0.50,    1.0,   1.0,  1.0, 2.0, 2.0, 3.0, 3.0,
+		1.00,    1.0,   1.0,  1.0, 2.0, 2.0, 3.0, 4.0,
+		1.00,    1.0,   1.0,  2.0, 2.0, 2.0, 3.0, 5.0,
+		1.00,    1.0,   2.0,  2.0, 3.0, 4.0, 5.0, 6.0,
+		1.00,    1.0,   2.0,  3.0, 4.0, 5.0, 6.0, 7.0,
+		1.00,    2.0,   3.0,  4.0, 5.0, 6.0, 7.0, 7.0,
+		1.00,    2.0,   3.0,  4.0, 5.0, 6.0, 7.0, 8.0,
+	};
+
+	WarblerBank(uint64_t seed = 0) : rng(seed) {
+		for (int i = 0; i < 128; i++) {
+			xint[i] = 0.f;
+			// every oscillator starts on its limit cycle rather than at the unstable origin
+			yint[i] = 1.f;
+			indets[i] = 0.f;
+		}
+		indets[0] = 0.001f;
+	}
+
+	void setSampleRate(float sampleRate) {
+		sampleTime = 1.f/sampleRate;
+		sqrtdelta = 1.0f/std::sqrt(sampleRate);
+	}
+
+	// Advances channel c by one sample at V/oct pitch with external input
+	// extin; x and y get the summed oscillators, clamped to +-5.
+	void step(int c, const Controls& k, float pitch, float extin, float* x, float* y) {
+		float xsum = 0.f;
+		float ysum = 0.f;
+		int spacing = 8/active;
+		float noiseDraws[8];
+		rng.normals(noiseDraws, active);
+		for (int ri = 0; ri < 8; ri += spacing) {
+			float rf = mults[k.harmonics*8 + ri];
+			pitch = clamp(pitch + indets[c*8 + ri], -5.f, 5.f);
+			float rad2 = xint[c*8 + ri]*xint[c*8 + ri] + yint[c*8 + ri]*yint[c*8 + ri];
+
+			float kf = FREQ_C4 * fastmath::exp2(pitch)*6.2831853f;
+			float r = noiseDraws[ri/spacing]*k.noise*sqrtdelta;
+			float xdnew = rf*kf*(-yint[c*8 + ri] + 2.f*xint[c*8 + ri]*(1.0f - rad2) + k.gain*extin)*sampleTime + r;
+
+			yint[c*8 + ri] += rf*kf*(xint[c*8 + ri] + 2.f*yint[c*8 + ri]*(1.0f - rad2))*sampleTime;
+			xint[c*8 + ri] += xdnew;
+			indets[c*8 + ri] += rf*kf*(r + dets[ri]*k.detune - indets[c*8 + ri])*sampleTime;
+
+			xint[c*8 + ri] = clamp(xint[c*8 + ri], -1.25f, 1.25f);
+			yint[c*8 + ri] = clamp(yint[c*8 + ri], -1.25f, 1.25f);
+
+			xsum += xint[c*8 + ri];
+			ysum += yint[c*8 + ri];
+		}
+		*x = clamp(xsum*spacing/2.f,-5.f,5.f);
+		*y = clamp(ysum*spacing/2.f,-5.f,5.f);
+	}
+
+	// Advances every channel by one sample, through the kernels when all eight
+	// oscillators run; the same as step() on each channel in turn. k, pitch,
+	// extin, x and y hold one entry per channel.
+	void stepAll(int channels, const Controls* k, const float* pitch, const float* extin, float* x, float* y) {
+		if (active != 8) {
+			for (int c = 0; c < channels; c++)
+				step(c, k[c], pitch[c], extin[c], &x[c], &y[c]);
+			return;
+		}
+		int lanes = channels*8;
+		float noiseDraws[128];
+		rng.normals(noiseDraws, lanes);
+		// each oscillator's pitch runs on from the one before it in the channel
+		float lanePitch[128], rate[128], kick[128], push[128], drift[128];
+		for (int c = 0; c < channels; c++) {
+			float p = pitch[c];
+			for (int ri = 0; ri < 8; ri++) {
+				int i = c*8 + ri;
+				p = clamp(p + indets[i], -5.f, 5.f);
+				lanePitch[i] = p;
+				rate[i] = mults[k[c].harmonics*8 + ri];
+				kick[i] = noiseDraws[i]*k[c].noise*sqrtdelta;
+				push[i] = k[c].gain*extin[c];
+				drift[i] = dets[ri]*k[c].detune;
+			}
+		}
+		WarblerLanes w = {lanes, xint, yint, indets, lanePitch, rate, kick, push, drift, sampleTime};
+		kernels.warbler(w);
+		for (int c = 0; c < channels; c++) {
+			float xsum = 0.f;
+			float ysum = 0.f;
+			for (int ri = 0; ri < 8; ri++) {
+				xsum += xint[c*8 + ri];
+				ysum += yint[c*8 + ri];
+			}
+			x[c] = clamp(xsum/2.f,-5.f,5.f);
+			y[c] = clamp(ysum/2.f,-5.f,5.f);
+		}
+	}
+
+	// Runs frames samples of channels channels at fixed controls and pitch
+	// (V/oct) with no external input; xOut and yOut are frame major.
+	void process(int frames, int channels, const Controls& k, float pitch, float* xOut, float* yOut) {
+		Controls ks[16];
+		float pitches[16];
+		float extin[16] = {};
+		for (int c = 0; c < channels; c++) {
+			ks[c] = k;
+			pitches[c] = pitch;
+		}
+		for (int i = 0; i < frames; i++)
+			stepAll(channels, ks, pitches, extin, &xOut[i*channels], &yOut[i*channels]);
+	}
+};
+
+} // namespace zcdsp
@@ -1,4 +1,6 @@
 #include "plugin.hpp"
+#include "dsp/Random.hpp"
+#include "dsp/Kernels.hpp"
 
 
 Plugin* pluginInstance;
@@ -6,6 +8,8 @@ Plugin* pluginInstance;
 
 void init(Plugin* p) {
 	pluginInstance = p;
+	zcrandom::init();
+	zcdsp::selectKernels();
 
 	// Add modules here
 	p->addModel(modelBrownianBridge);
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+// Headless microbenchmark: constructs every model against the Rack mock and
+// drives process() with square waves on all inputs at several channel counts
+// and sample rates. Prints a table and optionally writes the same numbers as
+// JSON, so two builds can be diffed. --unpatched leaves every output without a
+// cable, which measures what an idle module costs; --inputs drives only the
+// listed input ids and leaves the rest unpatched, e.g. a trigger but no CV.
+// --kernels runs the DSP kernels built for another instruction set than the
+// widest this CPU runs (see src/dsp/Kernels.hpp).
+//
+//   bench [--samples N] [--module SLUG] [--json FILE] [--unpatched] [--inputs ID,ID,...] [--kernels NAME]
+#include "harness.hpp"
+#include "dsp/Kernels.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static const int channelCounts[] = {1, 4, 16};
+static const float sampleRates[] = {44100.f, 48000.f, 96000.f, 192000.f};
+static const int block = 64;
+
+struct Result {
+	std::string slug;
+	int channels;
+	float sampleRate;
+	double nsPerSample;
+	double worstBlockNs; // slowest 64-sample block, where control-rate spikes show up
+};
+
+// Input i toggles between 0V and 2V every (i + 1)*256 samples, offset by channel,
+// so trigger inputs fire and CV inputs move without driving anything to extremes.
+static void driveInputs(Module* module, int64_t frame, int channels, uint32_t driven) {
+	for (size_t i = 0; i < module->inputs.size(); i++) {
+		if (!((driven >> i) & 1))
+			continue;
+		Input& input = module->inputs[i];
+		input.channels = channels;
+		int64_t halfPeriod = (int64_t) (i + 1)*256;
+		for (int c = 0; c < channels; c++)
+			input.voltages[c] = (((frame + c*block)/halfPeriod) & 1) ? 2.f : 0.f;
+	}
+}
+
+static Result runConfig(Model* model, int channels, float sampleRate, int samples, bool patched, uint32_t driven) {
+	harness::setSampleRate(sampleRate);
+	Module* module = model->createModule();
+	module->onSampleRateChange();
+	if (patched)
+		harness::connectOutputs(module);
+	Module::ProcessArgs args = harness::processArgs(sampleRate);
+
+	Result result;
+	result.slug = model->slug;
+	result.channels = channels;
+	result.sampleRate = sampleRate;
+	result.nsPerSample = 1e30;
+	result.worstBlockNs = 1e30;
+	// warm-up pass, then the fastest of three timed passes
+	for (int pass = 0; pass < 4; pass++) {
+		double worst = 0.0;
+		auto start = std::chrono::steady_clock::now();
+		for (int s = 0; s < samples; s += block) {
+			driveInputs(module, args.frame, channels, driven);
+			auto blockStart = std::chrono::steady_clock::now();
+			for (int k = 0; k < block; k++) {
+				module->process(args);
+				args.frame++;
+			}
+			worst = std::max(worst, harness::secondsSince(blockStart)*1e9);
+		}
+		double ns = harness::secondsSince(start)*1e9/samples;
+		if (pass > 0) {
+			result.nsPerSample = std::min(result.nsPerSample, ns);
+			result.worstBlockNs = std::min(result.worstBlockNs, worst);
+		}
+	}
+	delete module;
+	return result;
+}
+
+static double constructionMicros(Model* model) {
+	harness::setSampleRate(48000.f);
+	const int count = 20;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++)
+		delete model->createModule();
+	return harness::secondsSince(start)*1e6/count;
+}
+
+int main(int argc, char** argv) {
+	int samples = 1 << 16;
+	std::string only;
+	std::string jsonPath;
+	bool patched = true;
+	uint32_t driven = ~0u;
+	std::string kernelName;
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--samples") && i + 1 < argc)
+			samples = std::max(block, std::atoi(argv[++i])/block*block);
+		else if (!std::strcmp(argv[i], "--module") && i + 1 < argc)
+			only = argv[++i];
+		else if (!std::strcmp(argv[i], "--json") && i + 1 < argc)
+			jsonPath = argv[++i];
+		else if (!std::strcmp(argv[i], "--unpatched"))
+			patched = false;
+		else if (!std::strcmp(argv[i], "--inputs") && i + 1 < argc) {
+			driven = 0;
+			for (char* id = std::strtok(argv[++i], ","); id; id = std::strtok(nullptr, ","))
+				driven |= 1u << std::atoi(id);
+		}
+		else if (!std::strcmp(argv[i], "--kernels") && i + 1 < argc)
+			kernelName = argv[++i];
+		else {
+			std::fprintf(stderr, "usage: %s [--samples N] [--module SLUG] [--json FILE] [--unpatched] [--inputs ID,ID,...] [--kernels NAME]\n", argv[0]);
+			return 1;
+		}
+	}
+	harness::loadPlugin();
+	if (!kernelName.empty()) {
+		const zcdsp::Kernels* sets[8];
+		int count = zcdsp::supportedKernels(sets, 8);
+		int k = 0;
+		while (k < count && kernelName != sets[k]->name)
+			k++;
+		if (k == count) {
+			std::fprintf(stderr, "kernel set %s not available here\n", kernelName.c_str());
+			return 1;
+		}
+		zcdsp::kernels = *sets[k];
+	}
+
+	json_t* rootJ = json_object();
+	json_object_set_new(rootJ, "compiler", json_string(__VERSION__));
+	json_object_set_new(rootJ, "samples", json_integer(samples));
+	json_object_set_new(rootJ, "patched", json_boolean(patched));
+	json_object_set_new(rootJ, "inputs", json_integer(driven));
+	json_object_set_new(rootJ, "kernels", json_string(zcdsp::kernels.name));
+	json_t* modulesJ = json_array();
+
+	std::printf("kernels: %s\n", zcdsp::kernels.name);
+	std::printf("%-18s %10s %10s   ns/sample at 1/4/16 channels\n", "module", "bytes", "ctor us");
+	for (Model* model : harness::loadPlugin()->models) {
+		if (!only.empty() && model->slug != only)
+			continue;
+		double ctor = constructionMicros(model);
+		std::printf("%-18s %10zu %10.1f\n", model->slug.c_str(), model->moduleSize, ctor);
+
+		json_t* moduleJ = json_object();
+		json_object_set_new(moduleJ, "slug", json_string(model->slug.c_str()));
+		json_object_set_new(moduleJ, "bytes", json_integer(model->moduleSize));
+		json_object_set_new(moduleJ, "construct_us", json_real(ctor));
+		json_t* runsJ = json_array();
+		for (float sampleRate : sampleRates) {
+			std::printf("  %8.0f Hz", sampleRate);
+			for (int channels : channelCounts) {
+				Result r = runConfig(model, channels, sampleRate, samples, patched, driven);
+				std::printf(" %9.1f", r.nsPerSample);
+				json_t* runJ = json_object();
+				json_object_set_new(runJ, "channels", json_integer(channels));
+				json_object_set_new(runJ, "sample_rate", json_real(sampleRate));
+				json_object_set_new(runJ, "ns_per_sample", json_real(r.nsPerSample));
+				json_object_set_new(runJ, "worst_block_ns", json_real(r.worstBlockNs));
+				json_array_append_new(runsJ, runJ);
+			}
+			std::printf("\n");
+		}
+		json_object_set_new(moduleJ, "runs", runsJ);
+		json_array_append_new(modulesJ, moduleJ);
+	}
+	json_object_set_new(rootJ, "modules", modulesJ);
+
+	if (!jsonPath.empty()) {
+		FILE* f = std::fopen(jsonPath.c_str(), "w");
+		if (!f) {
+			std::fprintf(stderr, "cannot write %s\n", jsonPath.c_str());
+			return 1;
+		}
+		char* text = json_dumps(rootJ, 0);
+		std::fprintf(f, "%s\n", text);
+		std::free(text);
+		std::fclose(f);
+	}
+	json_decref(rootJ);
+	return 0;
+}
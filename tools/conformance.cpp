@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+// Statistical conformance checks for the stochastic and Markov modules.
+// Rather than matching a golden render sample for sample, each check runs
+// many independent instances (16 channels each, spread over all cores) and
+// tests a statistic against its analytic value: every channel gives one
+// estimate, and the check passes when the mean of the estimates lies within
+// Z standard errors of the expected value, plus a stated allowance for the
+// known bias of the module's discretisation.
+//
+//   conformance [--instances N] [--threads N] [--z Z]
+#include "harness.hpp"
+#include "MarkovStats.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static int instanceCount = 16;
+static int threadCount = 0;
+static double zLimit = 4.5;
+
+// estimates[metric][replica]
+typedef std::vector<std::vector<double>> Estimates;
+typedef std::function<void(Module* module, Estimates& out)> Job;
+
+// Runs job on instanceCount fresh modules in parallel, each with its own seed,
+// and gathers the per-channel estimates of every metric.
+static Estimates runInstances(const std::string& slug, float sampleRate, int metrics, json_t* dataJ, Job job) {
+	Model* model = harness::findModel(slug);
+	harness::setSampleRate(sampleRate);
+	Estimates all(metrics);
+	std::mutex mutex;
+	std::atomic<int> next(0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threadCount; t++) {
+		workers.push_back(std::thread([&]() {
+			Estimates local(metrics);
+			for (int i = next++; i < instanceCount; i = next++) {
+				random::seed(1000 + i);
+				Module* module = model->createModule();
+				module->onSampleRateChange();
+				json_t* seedJ = json_object();
+				json_object_set_new(seedJ, "seed", json_integer(1000 + i));
+				module->dataFromJson(seedJ);
+				json_decref(seedJ);
+				if (dataJ)
+					module->dataFromJson(dataJ);
+				harness::connectOutputs(module);
+				job(module, local);
+				delete module;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			for (int m = 0; m < metrics; m++)
+				all[m].insert(all[m].end(), local[m].begin(), local[m].end());
+		}));
+	}
+	for (std::thread& worker : workers)
+		worker.join();
+	if (dataJ)
+		json_decref(dataJ);
+	return all;
+}
+
+static int failures = 0;
+
+static void check(const std::string& name, double expected, const std::vector<double>& estimates, double allowance = 0.0) {
+	double n = estimates.size();
+	double mean = 0.0, sumSquares = 0.0;
+	for (double e : estimates)
+		mean += e;
+	mean /= n;
+	for (double e : estimates)
+		sumSquares += (e - mean)*(e - mean);
+	double stderror = std::sqrt(sumSquares/(n - 1.0)/n);
+	double bound = zLimit*stderror + allowance;
+	bool pass = std::fabs(mean - expected) <= bound;
+	if (!pass)
+		failures++;
+	std::printf("%s %-44s expected %9.5f observed %9.5f +- %.5f (n=%d)\n", pass ? "ok  " : "FAIL",
+		name.c_str(), expected, mean, bound, (int) n);
+}
+
+static void setInputs(Module* module, int input, float voltage, int channels = 16) {
+	module->inputs[input].channels = channels;
+	for (int c = 0; c < channels; c++)
+		module->inputs[input].voltages[c] = voltage;
+}
+
+// Mean and variance of OU around the mean. Euler steps make the stationary
+// variance sigma^2/(theta (2 - theta dt)), which is what is tested.
+static void checkOrnsteinUhlenbeck() {
+	const float sr = 48000.f, sigma = 1.f, theta = 5.f, mu = 1.f;
+	const int burn = 2*sr, length = 20*sr;
+	Estimates e = runInstances("OrnsteinUhlenbeck", sr, 2, nullptr, [&](Module* m, Estimates& out) {
+		m->params[0].setValue(sigma);
+		m->params[1].setValue(theta);
+		m->params[2].setValue(mu);
+		setInputs(m, 0, 0.f);
+		Module::ProcessArgs args = harness::processArgs(sr);
+		double sum[16] = {}, sumSquares[16] = {};
+		for (int s = 0; s < burn + length; s++) {
+			m->process(args);
+			if (s < burn)
+				continue;
+			for (int c = 0; c < 16; c++) {
+				double x = m->outputs[0].voltages[c];
+				sum[c] += x;
+				sumSquares[c] += x*x;
+			}
+		}
+		for (int c = 0; c < 16; c++) {
+			double mean = sum[c]/length;
+			out[0].push_back(mean);
+			out[1].push_back(sumSquares[c]/length - mean*mean);
+		}
+	});
+	double dt = 1.0/sr;
+	check("OrnsteinUhlenbeck stationary mean", mu, e[0]);
+	check("OrnsteinUhlenbeck stationary variance", sigma*sigma/(theta*(2.0 - theta*dt)), e[1]);
+}
+
+// With SIG unpatched OU only advances once per block through the exact
+// transition, so the value seen just after patching a cable again must still be
+// a draw from the stationary distribution. Idle stretches are 1 s, long enough
+// for successive draws to be practically independent.
+static void checkOrnsteinUhlenbeckIdle() {
+	const float sr = 48000.f, sigma = 1.f, theta = 5.f, mu = 1.f;
+	const int cycles = 200, idle = sr, patched = 64;
+	Estimates e = runInstances("OrnsteinUhlenbeck", sr, 2, nullptr, [&](Module* m, Estimates& out) {
+		m->params[0].setValue(sigma);
+		m->params[1].setValue(theta);
+		m->params[2].setValue(mu);
+		setInputs(m, 0, 0.f);
+		Module::ProcessArgs args = harness::processArgs(sr);
+		double sum[16] = {}, sumSquares[16] = {};
+		for (int k = 0; k < cycles; k++) {
+			m->outputs[0].channels = 0;
+			for (int s = 0; s < idle; s++)
+				m->process(args);
+			m->outputs[0].channels = 1;
+			for (int s = 0; s < patched; s++)
+				m->process(args);
+			for (int c = 0; c < 16; c++) {
+				double x = m->outputs[0].voltages[c];
+				sum[c] += x;
+				sumSquares[c] += x*x;
+			}
+		}
+		for (int c = 0; c < 16; c++) {
+			double mean = sum[c]/cycles;
+			out[0].push_back(mean);
+			out[1].push_back(sumSquares[c]/cycles - mean*mean);
+		}
+	});
+	check("OrnsteinUhlenbeck mean after idle", mu, e[0]);
+	check("OrnsteinUhlenbeck variance after idle", sigma*sigma/(2.0*theta), e[1], 0.1*0.01);
+}
+
+// With no position feedback IOU's OU output is a plain OU process, whose
+// autocorrelation at lag k is (1 - theta dt)^k; the noise output is white.
+// With feedback the integrated output is a noise-driven damped oscillator
+// x'' + g x' + k x = sigma xi, with stationary variance sigma^2/(2 g k).
+static void checkIOU() {
+	const float sr = 48000.f, sigma = 1.f;
+	const int burn = 2*sr, length = 20*sr;
+	const int lags[2] = {480, 2400};
+	const float theta = 10.f;
+	Estimates e = runInstances("IOU", sr, 4, nullptr, [&](Module* m, Estimates& out) {
+		m->params[0].setValue(sigma);
+		m->params[1].setValue(theta);
+		m->params[2].setValue(0.f);
+		m->params[4].setValue(0.f);
+		setInputs(m, 0, 0.f);
+		Module::ProcessArgs args = harness::processArgs(sr);
+		// the last lags[1] OU values of each channel, for the lagged products
+		const int history = lags[1];
+		std::vector<float> past(16*history);
+		double sum[16] = {}, sumSquares[16] = {}, lagged[2][16] = {}, laggedSum[2][16] = {};
+		double noiseSquares[16] = {}, noiseLagged[16] = {};
+		float lastNoise[16] = {};
+		for (int s = 0; s < burn + length; s++) {
+			m->process(args);
+			if (s < burn)
+				continue;
+			int t = s - burn;
+			for (int c = 0; c < 16; c++) {
+				float x = m->outputs[1].voltages[c];
+				float w = m->outputs[0].voltages[c];
+				float* h = &past[c*history];
+				sum[c] += x;
+				sumSquares[c] += (double) x*x;
+				for (int l = 0; l < 2; l++) {
+					if (t >= lags[l]) {
+						float before = h[(t - lags[l]) % history];
+						lagged[l][c] += (double) x*before;
+						laggedSum[l][c] += before;
+					}
+				}
+				h[t % history] = x;
+				noiseSquares[c] += (double) w*w;
+				if (t > 0)
+					noiseLagged[c] += (double) w*lastNoise[c];
+				lastNoise[c] = w;
+			}
+		}
+		for (int c = 0; c < 16; c++) {
+			double mean = sum[c]/length;
+			double var = sumSquares[c]/length - mean*mean;
+			for (int l = 0; l < 2; l++) {
+				int pairs = length - lags[l];
+				double cov = lagged[l][c]/pairs - mean*laggedSum[l][c]/pairs;
+				out[l].push_back(cov/var);
+			}
+			out[2].push_back(noiseLagged[c]/noiseSquares[c]);
+			out[3].push_back(noiseSquares[c]/length);
+		}
+	});
+	double rho = 1.0 - theta/sr;
+	check("IOU OU autocorrelation at 10 ms", std::pow(rho, lags[0]), e[0]);
+	check("IOU OU autocorrelation at 50 ms", std::pow(rho, lags[1]), e[1]);
+	check("IOU noise lag-1 autocorrelation", 0.0, e[2]);
+	check("IOU noise variance", sigma*sigma, e[3]);
+
+	const float friction = 2.f, stiffness = 4.f;
+	Estimates f = runInstances("IOU", sr, 1, nullptr, [&](Module* m, Estimates& out) {
+		m->params[0].setValue(sigma);
+		m->params[1].setValue(friction);
+		m->params[2].setValue(stiffness);
+		m->params[3].setValue(0.f);
+		m->params[4].setValue(0.f);
+		setInputs(m, 0, 0.f);
+		Module::ProcessArgs args = harness::processArgs(sr);
+		double sum[16] = {}, sumSquares[16] = {};
+		for (int s = 0; s < burn + length; s++) {
+			m->process(args);
+			if (s < burn)
+				continue;
+			for (int c = 0; c < 16; c++) {
+				double x = m->outputs[2].voltages[c];
+				sum[c] += x;
+				sumSquares[c] += x*x;
+			}
+		}
+		for (int c = 0; c < 16; c++) {
+			double mean = sum[c]/length;
+			out[0].push_back(sumSquares[c]/length - mean*mean);
+		}
+	});
+	double expected = sigma*sigma/(2.0*friction*stiffness);
+	// Euler-Maruyama bias is O(dt); allow 1%
+	check("IOU integrated output variance", expected, f[0], 0.01*expected);
+}
+
+// Brownian bridge from offset to offset+range over T seconds with noise level
+// sigma = noise*range: it ends exactly on its target, and at time t its mean
+// is linear and its variance is sigma^2 t (T - t)/T.
+static void checkBrownianBridge() {
+	const float sr = 12000.f, range = 5.f, noise = 1.f, T = 1.f;
+	const int bridges = 40, period = (int) (1.25f*T*sr);
+	const float fractions[3] = {0.25f, 0.5f, 0.75f};
+	Estimates e = runInstances("BrownianBridge", sr, 7, nullptr, [&](Module* m, Estimates& out) {
+		m->params[0].setValue(noise);
+		m->params[1].setValue(range);
+		m->params[2].setValue(0.f);
+		m->params[3].setValue(std::log2(T));
+		for (int i = 0; i < 4; i++)
+			setInputs(m, i, 0.f);
+		Module::ProcessArgs args = harness::processArgs(sr);
+		for (int b = 0; b < bridges; b++) {
+			double at[3][16];
+			double end[16];
+			for (int s = 0; s < period; s++) {
+				setInputs(m, 4, s < period/2 ? 10.f : 0.f);
+				m->process(args);
+				// the bridge time after the trigger sample is (s + 1)/sr
+				for (int k = 0; k < 3; k++)
+					if (s + 1 == (int) (fractions[k]*T*sr))
+						for (int c = 0; c < 16; c++)
+							at[k][c] = m->outputs[0].voltages[c];
+				if (s == period - 1)
+					for (int c = 0; c < 16; c++)
+						end[c] = m->outputs[0].voltages[c];
+			}
+			for (int c = 0; c < 16; c++) {
+				for (int k = 0; k < 3; k++) {
+					out[k].push_back(at[k][c]);
+					double mean = range*fractions[k];
+					out[3 + k].push_back((at[k][c] - mean)*(at[k][c] - mean));
+				}
+				out[6].push_back(std::fabs(end[c] - range));
+			}
+		}
+	});
+	double sigma2 = (noise*range)*(noise*range);
+	for (int k = 0; k < 3; k++) {
+		double t = fractions[k]*T;
+		check(string::f("BrownianBridge mean at t=%.2fT", fractions[k]), range*fractions[k], e[k]);
+		check(string::f("BrownianBridge variance at t=%.2fT", fractions[k]), sigma2*t*(T - t)/T, e[3 + k]);
+	}
+	check("BrownianBridge distance from endpoint", 0.0, e[6], 1e-6);
+}
+
+// Feeds a trigger every other sample and hands each post-trigger sample to visit.
+static void runTriggered(Module* m, int triggerInput, float sr, int steps, std::function<void()> visit) {
+	Module::ProcessArgs args = harness::processArgs(sr);
+	for (int s = 0; s < 2*steps; s++) {
+		setInputs(m, triggerInput, (s & 1) ? 0.f : 10.f);
+		m->process(args);
+		if (!(s & 1))
+			visit();
+	}
+}
+
+// Two-state chain with P(A->A) = pa, P(B->B) = pb: pi_A = (1 - pb)/(2 - pa - pb).
+// Emissions in A take the e1 value with probability pae1.
+static void checkRosenchance() {
+	const float sr = 48000.f, pa = 0.8f, pb = 0.6f, pae1 = 0.3f;
+	const int burn = 1000, steps = 200000;
+	Estimates e = runInstances("Rosenchance", sr, 2, nullptr, [&](Module* m, Estimates& out) {
+		m->params[0].setValue(pa);
+		m->params[4].setValue(pb);
+		m->params[1].setValue(pae1);
+		m->params[2].setValue(-1.f);
+		m->params[3].setValue(1.f);
+		int inA[16] = {}, e1InA[16] = {};
+		int n = 0;
+		runTriggered(m, 0, sr, burn + steps, [&]() {
+			if (n++ < burn)
+				return;
+			for (int c = 0; c < 16; c++) {
+				if (m->outputs[1].voltages[c] == 1.f) {
+					inA[c]++;
+					if (m->outputs[0].voltages[c] == -1.f)
+						e1InA[c]++;
+				}
+			}
+		});
+		for (int c = 0; c < 16; c++) {
+			out[0].push_back((double) inA[c]/steps);
+			out[1].push_back((double) e1InA[c]/inA[c]);
+		}
+	});
+	check("Rosenchance stationary P(A)", (1.0 - pb)/(2.0 - pa - pb), e[0]);
+	check("Rosenchance P(e1 | A)", pae1, e[1]);
+}
+
+// GuildensTurn's ring chain, triggered and free running, against the stationary
+// distribution of its transition matrix (or generator, uniformised).
+static const float ringProbs[8] = {0.1f, 0.5f, 0.2f, 0.3f, 0.4f, 0.4f, 0.1f, 0.6f};
+
+static void ringMatrix(float scale, float P[4][4]) {
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++)
+			P[i][j] = 0.f;
+		float back = ringProbs[2*i]*scale, forward = ringProbs[2*i + 1]*scale;
+		P[i][(i + 3) % 4] = back;
+		P[i][(i + 1) % 4] = forward;
+		P[i][i] = 1.f - back - forward;
+	}
+}
+
+static void checkGuildensTurn() {
+	const float sr = 48000.f;
+	const int burn = 1000, steps = 200000;
+	auto setup = [](Module* m) {
+		for (int i = 0; i < 8; i++)
+			m->params[i].setValue(ringProbs[i]);
+		for (int i = 1; i <= 4; i++)
+			setInputs(m, i, (float) i);
+	};
+	Estimates e = runInstances("GuildensTurn", sr, 4, nullptr, [&](Module* m, Estimates& out) {
+		setup(m);
+		int counts[16][4] = {};
+		int n = 0;
+		runTriggered(m, 0, sr, burn + steps, [&]() {
+			if (n++ < burn)
+				return;
+			for (int c = 0; c < 16; c++)
+				counts[c][(int) m->outputs[1].voltages[c] - 1]++;
+		});
+		for (int c = 0; c < 16; c++)
+			for (int s = 0; s < 4; s++)
+				out[s].push_back((double) counts[c][s]/steps);
+	});
+	float P[4][4], pi[4];
+	ringMatrix(1.f, P);
+	stationaryDistribution<4>(P, pi);
+	for (int s = 0; s < 4; s++)
+		check(string::f("GuildensTurn stationary P(%c)", 'A' + s), pi[s], e[s]);
+
+	// free running: knobs are rates in units of rateScale Hz
+	const float rateScale = 100.f;
+	const int length = 20*sr;
+	json_t* dataJ = json_object();
+	json_object_set_new(dataJ, "continuoustime", json_true());
+	json_object_set_new(dataJ, "ratescale", json_real(rateScale));
+	Estimates f = runInstances("GuildensTurn", sr, 5, dataJ, [&](Module* m, Estimates& out) {
+		setup(m);
+		Module::ProcessArgs args = harness::processArgs(sr);
+		int counts[16][4] = {};
+		int exitsA[16] = {};
+		int last[16];
+		for (int s = 0; s < length; s++) {
+			m->process(args);
+			for (int c = 0; c < 16; c++) {
+				int state = (int) m->outputs[1].voltages[c] - 1;
+				counts[c][state]++;
+				if (s > 0 && last[c] == 0 && state != 0)
+					exitsA[c]++;
+				last[c] = state;
+			}
+		}
+		for (int c = 0; c < 16; c++) {
+			for (int s = 0; s < 4; s++)
+				out[s].push_back((double) counts[c][s]/length);
+			out[4].push_back(counts[c][0]/sr/std::max(exitsA[c], 1));
+		}
+	});
+	// uniformised with the largest possible exit rate, 2 rateScale
+	ringMatrix(0.5f, P);
+	stationaryDistribution<4>(P, pi);
+	// holding times are whole samples, a bias of about half a sample per visit
+	for (int s = 0; s < 4; s++)
+		check(string::f("GuildensTurn free-running P(%c)", 'A' + s), pi[s], f[s], 0.005);
+	double dwellA = 1.0/((ringProbs[0] + ringProbs[1])*rateScale);
+	check("GuildensTurn free-running mean dwell in A (s)", dwellA, f[4], 0.5/sr + 0.005*dwellA);
+}
+
+int main(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--instances") && i + 1 < argc)
+			instanceCount = std::max(2, std::atoi(argv[++i]));
+		else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc)
+			threadCount = std::atoi(argv[++i]);
+		else if (!std::strcmp(argv[i], "--z") && i + 1 < argc)
+			zLimit = std::atof(argv[++i]);
+		else {
+			std::fprintf(stderr, "usage: %s [--instances N] [--threads N] [--z Z]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	harness::loadPlugin();
+
+	auto start = std::chrono::steady_clock::now();
+	checkOrnsteinUhlenbeck();
+	checkOrnsteinUhlenbeckIdle();
+	checkIOU();
+	checkBrownianBridge();
+	checkRosenchance();
+	checkGuildensTurn();
+	std::printf("%d failed, %.1f s on %d threads\n", failures, harness::secondsSince(start), threadCount);
+	return failures ? 1 : 0;
+}
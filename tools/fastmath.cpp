@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+// Accuracy of fastmath::exp2 and fastmath::sin, scalar and float_4, against
+// libm in double precision. Each range is swept densely in double, so the
+// errors include the rounding of the argument to float, and the largest is
+// checked against the bound documented in src/dsp/FastMath.hpp.
+//
+//   fastmath [--points N]
+#include "harness.hpp"
+#include "dsp/FastMath.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static long pointCount = 20000000;
+static int failures = 0;
+
+struct Error {
+	double worst = 0.0;
+	double at = 0.0;
+
+	void add(double error, double x) {
+		if (error > worst) {
+			worst = error;
+			at = x;
+		}
+	}
+};
+
+static void report(const char* name, const Error& error, double bound) {
+	bool pass = error.worst <= bound;
+	if (!pass)
+		failures++;
+	std::printf("%s %-42s max %.3g at %.7g, bound %.3g\n", pass ? "ok  " : "FAIL", name, error.worst, error.at, bound);
+}
+
+// f on every x of the sweep of [lo, hi], four at a time for the float_4 form;
+// xf holds them rounded to float
+template <typename F>
+static void sweep(double lo, double hi, F f) {
+	for (long i = 0; i < pointCount; i += 4) {
+		double x[4];
+		float xf[4];
+		for (int l = 0; l < 4; l++) {
+			x[l] = lo + (hi - lo)*(i + l)/(pointCount - 1);
+			xf[l] = (float) x[l];
+		}
+		f(x, xf);
+	}
+}
+
+static void checkExp2(double lo, double hi, double bound) {
+	Error scalar, vector;
+	sweep(lo, hi, [&](const double* x, const float* xf) {
+		simd::float_4 v = fastmath::exp2(simd::float_4::load(xf));
+		for (int l = 0; l < 4; l++) {
+			double exact = std::exp2(x[l]);
+			scalar.add(std::fabs(fastmath::exp2(xf[l]) - exact)/exact, x[l]);
+			vector.add(std::fabs(v[l] - exact)/exact, x[l]);
+		}
+	});
+	char name[64];
+	std::snprintf(name, sizeof(name), "exp2 relative, [%g, %g]", lo, hi);
+	report(name, scalar, bound);
+	std::snprintf(name, sizeof(name), "exp2 float_4 relative, [%g, %g]", lo, hi);
+	report(name, vector, bound);
+}
+
+static void checkSin(double lo, double hi, double bound) {
+	Error scalar, vector;
+	sweep(lo, hi, [&](const double* x, const float* xf) {
+		simd::float_4 v = fastmath::sin(simd::float_4::load(xf));
+		for (int l = 0; l < 4; l++) {
+			double exact = std::sin(x[l]);
+			scalar.add(std::fabs(fastmath::sin(xf[l]) - exact), x[l]);
+			vector.add(std::fabs(v[l] - exact), x[l]);
+		}
+	});
+	char name[64];
+	std::snprintf(name, sizeof(name), "sin absolute, [%g, %g]", lo, hi);
+	report(name, scalar, bound);
+	std::snprintf(name, sizeof(name), "sin float_4 absolute, [%g, %g]", lo, hi);
+	report(name, vector, bound);
+}
+
+int main(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--points") && i + 1 < argc)
+			pointCount = std::max(16L, std::atol(argv[++i]));
+		else {
+			std::fprintf(stderr, "usage: %s [--points N]\n", argv[0]);
+			return 2;
+		}
+	}
+	checkExp2(-20.0, 20.0, fastmath::EXP2_RELATIVE_ERROR);
+	checkSin(-2.0*M_PI, 2.0*M_PI, fastmath::SIN_ERROR_NEAR);
+	checkSin(-200.0, 200.0, fastmath::SIN_ERROR);
+	std::printf("%d failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+#pragma once
+// Shared plumbing for the command line tools: loads the plugin's models
+// against the Rack mock and runs modules outside of an engine.
+#include "plugin.hpp"
+#include <chrono>
+#include <string>
+
+// defined in src/plugin.cpp
+void init(Plugin* p);
+
+namespace harness {
+
+inline Plugin* loadPlugin() {
+	static Plugin* plugin = nullptr;
+	if (!plugin) {
+		plugin = new Plugin;
+		plugin->slug = "ZetaCarinae";
+		init(plugin);
+	}
+	return plugin;
+}
+
+inline Model* findModel(const std::string& slug) {
+	for (Model* model : loadPlugin()->models)
+		if (model->slug == slug)
+			return model;
+	return nullptr;
+}
+
+// Modules read the sample rate from APP->engine in their initializers, so it
+// has to be set before construction as well as announced afterwards.
+inline void setSampleRate(float sampleRate) {
+	APP->engine->setSampleRate(sampleRate);
+}
+
+inline Module::ProcessArgs processArgs(float sampleRate) {
+	Module::ProcessArgs args;
+	args.sampleRate = sampleRate;
+	args.sampleTime = 1.f/sampleRate;
+	args.frame = 0;
+	return args;
+}
+
+// Outputs must look patched or modules may skip work on them.
+inline void connectOutputs(Module* module, int channels = 1) {
+	for (Output& output : module->outputs)
+		output.channels = channels;
+}
+
+inline double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace harness
@@ -0,0 +1,724 @@
+#pragma once
+// Minimal stand-in for the VCV Rack 2 SDK headers, just large enough to
+// build this plugin's modules outside of Rack for the tools in this folder.
+// Only the API surface used by src/ is mirrored; widgets are inert.
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <simd/Vector.hpp>
+#include <simd/functions.hpp>
+
+
+// jansson subset
+struct json_t;
+typedef long long json_int_t;
+json_t* json_object();
+json_t* json_array();
+json_t* json_integer(json_int_t value);
+json_t* json_real(double value);
+json_t* json_string(const char* value);
+json_t* json_boolean(bool value);
+json_t* json_true();
+json_t* json_false();
+int json_object_set_new(json_t* object, const char* key, json_t* value);
+json_t* json_object_get(const json_t* object, const char* key);
+int json_array_append_new(json_t* array, json_t* value);
+size_t json_array_size(const json_t* array);
+json_t* json_array_get(const json_t* array, size_t index);
+json_int_t json_integer_value(const json_t* json);
+double json_real_value(const json_t* json);
+double json_number_value(const json_t* json);
+const char* json_string_value(const json_t* json);
+bool json_is_true(const json_t* json);
+bool json_is_false(const json_t* json);
+bool json_is_string(const json_t* json);
+bool json_is_integer(const json_t* json);
+bool json_is_number(const json_t* json);
+void json_decref(json_t* json);
+char* json_dumps(const json_t* json, size_t flags);
+#define JSON_COMPACT 0x20
+
+
+#define INFO(format, ...) std::fprintf(stderr, "[info] " format "\n", ##__VA_ARGS__)
+#define WARN(format, ...) std::fprintf(stderr, "[warn] " format "\n", ##__VA_ARGS__)
+#define DEBUG(format, ...) ((void) 0)
+#define CHECKMARK_STRING "✔"
+#define CHECKMARK(_cond) ((_cond) ? CHECKMARK_STRING : "")
+#define RACK_GRID_WIDTH 15
+#define RACK_GRID_HEIGHT 380
+#define ENUMS(name, count) name, name ## _LAST = name + (count) - 1
+
+
+namespace rack {
+
+
+namespace math {
+
+template <typename T>
+T clamp(T x, T a, T b) {
+	return std::max(std::min(x, b), a);
+}
+inline float clamp(float x, float a = 0.f, float b = 1.f) {
+	return std::fmax(std::fmin(x, b), a);
+}
+inline float rescale(float x, float xMin, float xMax, float yMin, float yMax) {
+	return yMin + (x - xMin) / (xMax - xMin) * (yMax - yMin);
+}
+inline float crossfade(float a, float b, float p) {
+	return a + (b - a) * p;
+}
+inline int log2(int n) {
+	int i = 0;
+	while (n >>= 1)
+		i++;
+	return i;
+}
+inline bool isPow2(int n) {
+	return n > 0 && (n & (n - 1)) == 0;
+}
+
+struct Vec {
+	float x = 0.f;
+	float y = 0.f;
+	Vec() {}
+	Vec(float xy) : x(xy), y(xy) {}
+	Vec(float x, float y) : x(x), y(y) {}
+	Vec plus(Vec b) const { return Vec(x + b.x, y + b.y); }
+	Vec minus(Vec b) const { return Vec(x - b.x, y - b.y); }
+	Vec mult(float s) const { return Vec(x * s, y * s); }
+	Vec div(float s) const { return Vec(x / s, y / s); }
+};
+
+struct Rect {
+	Vec pos;
+	Vec size;
+	Rect() {}
+	Rect(Vec pos, Vec size) : pos(pos), size(size) {}
+};
+
+} // namespace math
+
+using namespace math;
+
+inline Vec mm2px(Vec mm) {
+	return mm.mult(75.f / 25.4f);
+}
+
+
+namespace string {
+std::string f(const char* format, ...);
+std::string toBase64(const uint8_t* data, size_t dataLen);
+std::vector<uint8_t> fromBase64(const std::string& str);
+} // namespace string
+
+
+namespace random {
+uint64_t u64();
+uint32_t u32();
+float uniform();
+float normal();
+/** Mock only: reseeds the calling thread's generator so renders are repeatable. */
+void seed(uint64_t s);
+} // namespace random
+
+
+namespace dsp {
+
+static const float FREQ_C4 = 261.6256f;
+
+template <typename T = float>
+struct TSchmittTrigger {
+	T state;
+	TSchmittTrigger() {
+		reset();
+	}
+	void reset() {
+		state = T::mask();
+	}
+	T process(T in, T offThreshold = 0.f, T onThreshold = 1.f) {
+		T on = (in >= onThreshold);
+		T off = (in <= offThreshold);
+		T triggered = ~state & on;
+		state = on | (state & ~off);
+		return triggered;
+	}
+	T isHigh() {
+		return state;
+	}
+};
+
+template <>
+struct TSchmittTrigger<float> {
+	bool state = true;
+	void reset() {
+		state = true;
+	}
+	bool process(float in, float offThreshold = 0.f, float onThreshold = 1.f) {
+		if (state) {
+			if (in <= offThreshold)
+				state = false;
+		}
+		else if (in >= onThreshold) {
+			state = true;
+			return true;
+		}
+		return false;
+	}
+	bool isHigh() {
+		return state;
+	}
+};
+
+typedef TSchmittTrigger<> SchmittTrigger;
+
+struct PulseGenerator {
+	float remaining = 0.f;
+	void reset() {
+		remaining = 0.f;
+	}
+	bool process(float deltaTime) {
+		if (remaining > 0.f) {
+			remaining -= deltaTime;
+			return true;
+		}
+		return false;
+	}
+	void trigger(float duration = 1e-3f) {
+		if (duration > remaining)
+			remaining = duration;
+	}
+};
+
+struct ClockDivider {
+	uint32_t clock = 0;
+	uint32_t division = 1;
+	void reset() {
+		clock = 0;
+	}
+	void setDivision(uint32_t division) {
+		this->division = division;
+	}
+	uint32_t getDivision() {
+		return division;
+	}
+	uint32_t getClock() {
+		return clock;
+	}
+	bool process() {
+		clock++;
+		if (clock >= division) {
+			clock = 0;
+			return true;
+		}
+		return false;
+	}
+};
+
+} // namespace dsp
+
+
+namespace plugin {
+struct Model;
+struct Plugin;
+} // namespace plugin
+
+
+namespace engine {
+
+struct ParamQuantity {
+	float minValue = 0.f;
+	float maxValue = 1.f;
+	float defaultValue = 0.f;
+	std::string name;
+	std::string unit;
+	bool snapEnabled = false;
+	bool randomizeEnabled = true;
+	std::vector<std::string> labels;
+};
+
+struct PortInfo {
+	std::string name;
+	std::string description;
+};
+
+struct Param {
+	float value = 0.f;
+	float getValue() {
+		return value;
+	}
+	void setValue(float value) {
+		this->value = value;
+	}
+};
+
+struct Port {
+	union {
+		float voltages[16] = {};
+		float value;
+	};
+	uint8_t channels = 0;
+
+	void setVoltage(float voltage, int channel = 0) {
+		voltages[channel] = voltage;
+	}
+	float getVoltage(int channel = 0) {
+		return voltages[channel];
+	}
+	float* getVoltages(int firstChannel = 0) {
+		return &voltages[firstChannel];
+	}
+	float getPolyVoltage(int channel) {
+		return isMonophonic() ? getVoltage(0) : getVoltage(channel);
+	}
+	float getNormalVoltage(float normalVoltage, int channel = 0) {
+		return isConnected() ? getVoltage(channel) : normalVoltage;
+	}
+	template <typename T>
+	T getVoltageSimd(int firstChannel) {
+		return T::load(&voltages[firstChannel]);
+	}
+	template <typename T>
+	T getPolyVoltageSimd(int firstChannel) {
+		return isMonophonic() ? T(getVoltage(0)) : getVoltageSimd<T>(firstChannel);
+	}
+	template <typename T>
+	void setVoltageSimd(T voltage, int firstChannel) {
+		voltage.store(&voltages[firstChannel]);
+	}
+	float getVoltageSum() {
+		float sum = 0.f;
+		for (int c = 0; c < channels; c++)
+			sum += voltages[c];
+		return sum;
+	}
+	void setChannels(int channels) {
+		if (this->channels == 0)
+			return;
+		for (int c = channels; c < this->channels; c++)
+			voltages[c] = 0.f;
+		if (channels == 0)
+			channels = 1;
+		this->channels = channels;
+	}
+	int getChannels() {
+		return channels;
+	}
+	bool isConnected() {
+		return channels > 0;
+	}
+	bool isMonophonic() {
+		return channels == 1;
+	}
+	bool isPolyphonic() {
+		return channels > 1;
+	}
+};
+
+struct Input : Port {};
+struct Output : Port {};
+
+struct Light {
+	float value = 0.f;
+	void setBrightness(float brightness) {
+		value = brightness;
+	}
+	float getBrightness() {
+		return value;
+	}
+	void setBrightnessSmooth(float brightness, float deltaTime, float lambda = 30.f) {
+		value += (brightness - value) * lambda * deltaTime;
+	}
+};
+
+struct Module {
+	plugin::Model* model = nullptr;
+	int64_t id = -1;
+	std::vector<Param> params;
+	std::vector<Input> inputs;
+	std::vector<Output> outputs;
+	std::vector<Light> lights;
+	std::vector<ParamQuantity*> paramQuantities;
+	std::vector<PortInfo*> inputInfos;
+	std::vector<PortInfo*> outputInfos;
+
+	struct Expander {
+		int64_t moduleId = -1;
+		Module* module = nullptr;
+		void* producerMessage = nullptr;
+		void* consumerMessage = nullptr;
+		bool messageFlipRequested = false;
+		void requestMessageFlip() {
+			messageFlipRequested = true;
+		}
+	};
+	Expander leftExpander;
+	Expander rightExpander;
+
+	struct ProcessArgs {
+		float sampleRate;
+		float sampleTime;
+		int64_t frame;
+	};
+
+	Module() {}
+	virtual ~Module() {
+		for (ParamQuantity* pq : paramQuantities)
+			delete pq;
+		for (PortInfo* pi : inputInfos)
+			delete pi;
+		for (PortInfo* pi : outputInfos)
+			delete pi;
+	}
+
+	void config(int numParams, int numInputs, int numOutputs, int numLights = 0) {
+		params.resize(numParams);
+		inputs.resize(numInputs);
+		outputs.resize(numOutputs);
+		lights.resize(numLights);
+		paramQuantities.resize(numParams, nullptr);
+		inputInfos.resize(numInputs, nullptr);
+		outputInfos.resize(numOutputs, nullptr);
+	}
+
+	template <class TParamQuantity = ParamQuantity>
+	TParamQuantity* configParam(int paramId, float minValue, float maxValue, float defaultValue, std::string name = "", std::string unit = "", float displayBase = 0.f, float displayMultiplier = 1.f, float displayOffset = 0.f) {
+		delete paramQuantities[paramId];
+		TParamQuantity* q = new TParamQuantity;
+		q->minValue = minValue;
+		q->maxValue = maxValue;
+		q->defaultValue = defaultValue;
+		q->name = name;
+		q->unit = unit;
+		paramQuantities[paramId] = q;
+		params[paramId].value = defaultValue;
+		return q;
+	}
+
+	template <class TSwitchQuantity = ParamQuantity>
+	TSwitchQuantity* configSwitch(int paramId, float minValue, float maxValue, float defaultValue, std::string name = "", std::vector<std::string> labels = {}) {
+		TSwitchQuantity* q = configParam<TSwitchQuantity>(paramId, minValue, maxValue, defaultValue, name);
+		q->snapEnabled = true;
+		q->labels = labels;
+		return q;
+	}
+
+	PortInfo* configInput(int portId, std::string name = "") {
+		delete inputInfos[portId];
+		PortInfo* info = new PortInfo;
+		info->name = name;
+		inputInfos[portId] = info;
+		return info;
+	}
+
+	PortInfo* configOutput(int portId, std::string name = "") {
+		delete outputInfos[portId];
+		PortInfo* info = new PortInfo;
+		info->name = name;
+		outputInfos[portId] = info;
+		return info;
+	}
+
+	ParamQuantity* getParamQuantity(int index) {
+		return paramQuantities[index];
+	}
+	Expander& getLeftExpander() {
+		return leftExpander;
+	}
+	Expander& getRightExpander() {
+		return rightExpander;
+	}
+
+	virtual void process(const ProcessArgs& args) {}
+	virtual void onSampleRateChange() {}
+	virtual void onReset() {}
+	virtual json_t* dataToJson() {
+		return nullptr;
+	}
+	virtual void dataFromJson(json_t* rootJ) {}
+};
+
+struct Engine {
+	float sampleRate = 44100.f;
+	float getSampleRate() {
+		return sampleRate;
+	}
+	float getSampleTime() {
+		return 1.f / sampleRate;
+	}
+	/** Mock only: the Rack engine owns this in the real SDK. */
+	void setSampleRate(float sampleRate) {
+		this->sampleRate = sampleRate;
+	}
+};
+
+} // namespace engine
+
+using namespace engine;
+
+
+namespace widget {
+
+struct Widget {
+	Rect box;
+	std::list<Widget*> children;
+	virtual ~Widget() {
+		for (Widget* child : children)
+			delete child;
+	}
+	void addChild(Widget* child) {
+		children.push_back(child);
+	}
+};
+
+} // namespace widget
+
+using namespace widget;
+
+
+namespace window {
+struct Svg {};
+struct Window {
+	std::shared_ptr<Svg> loadSvg(const std::string& filename) {
+		return std::make_shared<Svg>();
+	}
+};
+} // namespace window
+
+
+namespace event {
+struct Action {};
+} // namespace event
+
+
+namespace ui {
+
+struct MenuEntry : widget::Widget {};
+
+struct Menu : widget::Widget {};
+
+struct MenuLabel : MenuEntry {
+	std::string text;
+};
+
+struct MenuSeparator : MenuEntry {};
+
+struct MenuItem : MenuEntry {
+	std::string text;
+	std::string rightText;
+	bool disabled = false;
+	virtual void onAction(const event::Action& e) {}
+	virtual Menu* createChildMenu() {
+		return nullptr;
+	}
+};
+
+} // namespace ui
+
+using namespace ui;
+
+
+namespace app {
+
+struct ParamWidget : widget::Widget {};
+struct PortWidget : widget::Widget {};
+struct LightWidget : widget::Widget {};
+struct ModuleLightWidget : LightWidget {};
+
+struct ModuleWidget : widget::Widget {
+	engine::Module* module = nullptr;
+	plugin::Model* model = nullptr;
+	void setModule(engine::Module* module) {
+		this->module = module;
+	}
+	void setPanel(std::shared_ptr<window::Svg> svg) {
+		box.size = Vec(RACK_GRID_WIDTH * 6, RACK_GRID_HEIGHT);
+	}
+	void addParam(ParamWidget* param) {
+		addChild(param);
+	}
+	void addInput(PortWidget* input) {
+		addChild(input);
+	}
+	void addOutput(PortWidget* output) {
+		addChild(output);
+	}
+	virtual void appendContextMenu(ui::Menu* menu) {}
+};
+
+} // namespace app
+
+using namespace app;
+
+
+namespace componentlibrary {
+
+struct ScrewSilver : widget::Widget {};
+struct RoundBlackKnob : app::ParamWidget {};
+struct RoundSmallBlackKnob : app::ParamWidget {};
+struct RoundLargeBlackKnob : app::ParamWidget {};
+struct Trimpot : app::ParamWidget {};
+struct CKSS : app::ParamWidget {};
+struct PJ301MPort : app::PortWidget {};
+struct GreenLight : app::ModuleLightWidget {};
+struct RedLight : app::ModuleLightWidget {};
+struct YellowLight : app::ModuleLightWidget {};
+struct GreenRedLight : app::ModuleLightWidget {};
+struct RedGreenBlueLight : app::ModuleLightWidget {};
+template <typename TBase>
+struct TinyLight : TBase {};
+template <typename TBase>
+struct SmallLight : TBase {};
+template <typename TBase>
+struct MediumLight : TBase {};
+
+} // namespace componentlibrary
+
+using namespace componentlibrary;
+
+
+namespace plugin {
+
+struct Model {
+	Plugin* plugin = nullptr;
+	std::string slug;
+	size_t moduleSize = 0;
+	std::function<engine::Module*()> moduleFactory;
+	std::function<app::ModuleWidget*(engine::Module*)> widgetFactory;
+	engine::Module* createModule() {
+		engine::Module* m = moduleFactory();
+		m->model = this;
+		return m;
+	}
+};
+
+struct Plugin {
+	std::string slug;
+	std::list<Model*> models;
+	void addModel(Model* model) {
+		model->plugin = this;
+		models.push_back(model);
+	}
+};
+
+} // namespace plugin
+
+using plugin::Plugin;
+using plugin::Model;
+
+
+namespace asset {
+std::string plugin(plugin::Plugin* plugin, std::string filename);
+std::string user(std::string filename);
+} // namespace asset
+
+
+struct Context {
+	engine::Engine* engine = nullptr;
+	window::Window* window = nullptr;
+};
+Context* contextGet();
+#define APP rack::contextGet()
+
+
+template <class TWidget>
+TWidget* createWidget(math::Vec pos) {
+	TWidget* o = new TWidget;
+	o->box.pos = pos;
+	return o;
+}
+
+template <class TWidget>
+TWidget* createWidgetCentered(math::Vec pos) {
+	return createWidget<TWidget>(pos);
+}
+
+template <class TParamWidget>
+TParamWidget* createParamCentered(math::Vec pos, engine::Module* module, int paramId) {
+	return createWidget<TParamWidget>(pos);
+}
+
+template <class TPortWidget>
+TPortWidget* createInputCentered(math::Vec pos, engine::Module* module, int inputId) {
+	return createWidget<TPortWidget>(pos);
+}
+
+template <class TPortWidget>
+TPortWidget* createOutputCentered(math::Vec pos, engine::Module* module, int outputId) {
+	return createWidget<TPortWidget>(pos);
+}
+
+template <class TModuleLightWidget>
+TModuleLightWidget* createLightCentered(math::Vec pos, engine::Module* module, int firstLightId) {
+	return createWidget<TModuleLightWidget>(pos);
+}
+
+template <class TMenuItem = ui::MenuItem>
+TMenuItem* createMenuItem(std::string text, std::string rightText = "") {
+	TMenuItem* o = new TMenuItem;
+	o->text = text;
+	o->rightText = rightText;
+	return o;
+}
+
+template <class TMenuItem = ui::MenuItem>
+TMenuItem* createMenuItem(std::string text, std::string rightText, std::function<void()> action, bool disabled = false, bool alwaysConsume = false) {
+	TMenuItem* o = createMenuItem<TMenuItem>(text, rightText);
+	o->disabled = disabled;
+	return o;
+}
+
+inline ui::MenuLabel* createMenuLabel(std::string text) {
+	ui::MenuLabel* o = new ui::MenuLabel;
+	o->text = text;
+	return o;
+}
+
+template <class TMenuItem = ui::MenuItem>
+ui::MenuItem* createCheckMenuItem(std::string text, std::string rightText, std::function<bool()> checked, std::function<void()> action, bool disabled = false, bool alwaysConsume = false) {
+	return createMenuItem<TMenuItem>(text, rightText);
+}
+
+template <class TMenuItem = ui::MenuItem>
+ui::MenuItem* createBoolPtrMenuItem(std::string text, std::string rightText, bool* ptr) {
+	return createMenuItem<TMenuItem>(text, rightText);
+}
+
+template <class TMenuItem = ui::MenuItem>
+ui::MenuItem* createSubmenuItem(std::string text, std::string rightText, std::function<void(ui::Menu* menu)> createMenu, bool disabled = false) {
+	return createMenuItem<TMenuItem>(text, rightText);
+}
+
+template <class TMenuItem = ui::MenuItem>
+ui::MenuItem* createIndexSubmenuItem(std::string text, std::vector<std::string> labels, std::function<size_t()> getter, std::function<void(size_t val)> setter, bool disabled = false, bool alwaysConsume = false) {
+	return createMenuItem<TMenuItem>(text);
+}
+
+template <typename T>
+ui::MenuItem* createIndexPtrSubmenuItem(std::string text, std::vector<std::string> labels, T* ptr) {
+	return createMenuItem<>(text);
+}
+
+template <class TModule, class TModuleWidget>
+plugin::Model* createModel(std::string slug) {
+	plugin::Model* o = new plugin::Model;
+	o->slug = slug;
+	o->moduleSize = sizeof(TModule);
+	o->moduleFactory = []() -> engine::Module* {
+		return new TModule;
+	};
+	o->widgetFactory = [](engine::Module* m) -> app::ModuleWidget* {
+		return new TModuleWidget(dynamic_cast<TModule*>(m));
+	};
+	return o;
+}
+
+
+} // namespace rack
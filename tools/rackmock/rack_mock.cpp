@@ -0,0 +1,284 @@
+// Definitions behind tools/rackmock/rack.hpp: a small jansson subset, string
+// and random helpers, and a single global Context whose engine the tools can
+// retune with setSampleRate().
+#include <rack.hpp>
+#include <cstdarg>
+#include <map>
+
+
+struct json_t {
+	enum Type { OBJECT, ARRAY, INTEGER, REAL, STRING, TRUE, FALSE } type;
+	std::map<std::string, json_t*> object;
+	std::vector<json_t*> array;
+	json_int_t integer = 0;
+	double real = 0.0;
+	std::string string;
+	explicit json_t(Type type) : type(type) {}
+};
+
+json_t* json_object() {
+	return new json_t(json_t::OBJECT);
+}
+json_t* json_array() {
+	return new json_t(json_t::ARRAY);
+}
+json_t* json_integer(json_int_t value) {
+	json_t* j = new json_t(json_t::INTEGER);
+	j->integer = value;
+	return j;
+}
+json_t* json_real(double value) {
+	json_t* j = new json_t(json_t::REAL);
+	j->real = value;
+	return j;
+}
+json_t* json_string(const char* value) {
+	json_t* j = new json_t(json_t::STRING);
+	j->string = value;
+	return j;
+}
+json_t* json_boolean(bool value) {
+	return new json_t(value ? json_t::TRUE : json_t::FALSE);
+}
+json_t* json_true() {
+	return json_boolean(true);
+}
+json_t* json_false() {
+	return json_boolean(false);
+}
+int json_object_set_new(json_t* object, const char* key, json_t* value) {
+	if (!object || object->type != json_t::OBJECT)
+		return -1;
+	json_t*& slot = object->object[key];
+	json_decref(slot);
+	slot = value;
+	return 0;
+}
+json_t* json_object_get(const json_t* object, const char* key) {
+	if (!object || object->type != json_t::OBJECT)
+		return nullptr;
+	auto it = object->object.find(key);
+	return it == object->object.end() ? nullptr : it->second;
+}
+int json_array_append_new(json_t* array, json_t* value) {
+	if (!array || array->type != json_t::ARRAY)
+		return -1;
+	array->array.push_back(value);
+	return 0;
+}
+size_t json_array_size(const json_t* array) {
+	return (array && array->type == json_t::ARRAY) ? array->array.size() : 0;
+}
+json_t* json_array_get(const json_t* array, size_t index) {
+	return index < json_array_size(array) ? array->array[index] : nullptr;
+}
+json_int_t json_integer_value(const json_t* json) {
+	return (json && json->type == json_t::INTEGER) ? json->integer : 0;
+}
+double json_real_value(const json_t* json) {
+	return (json && json->type == json_t::REAL) ? json->real : 0.0;
+}
+double json_number_value(const json_t* json) {
+	if (!json)
+		return 0.0;
+	if (json->type == json_t::INTEGER)
+		return (double) json->integer;
+	return json_real_value(json);
+}
+const char* json_string_value(const json_t* json) {
+	return (json && json->type == json_t::STRING) ? json->string.c_str() : nullptr;
+}
+bool json_is_true(const json_t* json) {
+	return json && json->type == json_t::TRUE;
+}
+bool json_is_false(const json_t* json) {
+	return json && json->type == json_t::FALSE;
+}
+bool json_is_string(const json_t* json) {
+	return json && json->type == json_t::STRING;
+}
+bool json_is_integer(const json_t* json) {
+	return json && json->type == json_t::INTEGER;
+}
+bool json_is_number(const json_t* json) {
+	return json && (json->type == json_t::INTEGER || json->type == json_t::REAL);
+}
+void json_decref(json_t* json) {
+	if (!json)
+		return;
+	for (auto& kv : json->object)
+		json_decref(kv.second);
+	for (json_t* j : json->array)
+		json_decref(j);
+	delete json;
+}
+
+static void dumpJson(const json_t* json, std::string& out) {
+	if (!json) {
+		out += "null";
+		return;
+	}
+	switch (json->type) {
+		case json_t::OBJECT: {
+			out += "{";
+			bool first = true;
+			for (auto& kv : json->object) {
+				if (!first)
+					out += ",";
+				first = false;
+				out += "\"" + kv.first + "\":";
+				dumpJson(kv.second, out);
+			}
+			out += "}";
+		} break;
+		case json_t::ARRAY: {
+			out += "[";
+			for (size_t i = 0; i < json->array.size(); i++) {
+				if (i > 0)
+					out += ",";
+				dumpJson(json->array[i], out);
+			}
+			out += "]";
+		} break;
+		case json_t::INTEGER: out += std::to_string(json->integer); break;
+		case json_t::REAL: out += rack::string::f("%.17g", json->real); break;
+		case json_t::STRING: out += "\"" + json->string + "\""; break;
+		case json_t::TRUE: out += "true"; break;
+		case json_t::FALSE: out += "false"; break;
+	}
+}
+
+char* json_dumps(const json_t* json, size_t flags) {
+	std::string out;
+	dumpJson(json, out);
+	return strdup(out.c_str());
+}
+
+
+namespace rack {
+
+
+namespace string {
+
+std::string f(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	va_list args2;
+	va_copy(args2, args);
+	int size = std::vsnprintf(nullptr, 0, format, args);
+	va_end(args);
+	std::string s(size, '\0');
+	std::vsnprintf(&s[0], size + 1, format, args2);
+	va_end(args2);
+	return s;
+}
+
+static const char* base64Chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string toBase64(const uint8_t* data, size_t dataLen) {
+	std::string s;
+	for (size_t i = 0; i < dataLen; i += 3) {
+		uint32_t n = (uint32_t) data[i] << 16;
+		if (i + 1 < dataLen)
+			n |= (uint32_t) data[i + 1] << 8;
+		if (i + 2 < dataLen)
+			n |= data[i + 2];
+		s += base64Chars[(n >> 18) & 63];
+		s += base64Chars[(n >> 12) & 63];
+		s += (i + 1 < dataLen) ? base64Chars[(n >> 6) & 63] : '=';
+		s += (i + 2 < dataLen) ? base64Chars[n & 63] : '=';
+	}
+	return s;
+}
+
+std::vector<uint8_t> fromBase64(const std::string& str) {
+	std::vector<uint8_t> data;
+	uint32_t n = 0;
+	int bits = 0;
+	for (char ch : str) {
+		const char* p = std::strchr(base64Chars, ch);
+		if (ch == '=' || !p || !ch)
+			continue;
+		n = (n << 6) | (uint32_t) (p - base64Chars);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			data.push_back((n >> bits) & 0xff);
+		}
+	}
+	return data;
+}
+
+} // namespace string
+
+
+namespace random {
+
+// per thread, so tools can construct modules from several threads
+static thread_local uint64_t state[2] = {0x9e3779b97f4a7c15ull, 0xbf58476d1ce4e5b9ull};
+
+static uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+uint64_t u64() {
+	uint64_t s0 = state[0];
+	uint64_t s1 = state[1];
+	uint64_t result = s0 + s1;
+	s1 ^= s0;
+	state[0] = rotl(s0, 24) ^ s1 ^ (s1 << 16);
+	state[1] = rotl(s1, 37);
+	return result;
+}
+
+uint32_t u32() {
+	return u64() >> 32;
+}
+
+float uniform() {
+	return (u32() >> 8) * (1.f / 16777216.f);
+}
+
+float normal() {
+	// Box-Muller
+	float u = uniform();
+	float v = uniform();
+	float r = std::sqrt(-2.f * std::log(1.f - u));
+	return r * std::cos(2.f * float(M_PI) * v);
+}
+
+void seed(uint64_t s) {
+	state[0] = s ^ 0x9e3779b97f4a7c15ull;
+	state[1] = (s * 0xbf58476d1ce4e5b9ull) | 1;
+	for (int i = 0; i < 8; i++)
+		u64();
+}
+
+} // namespace random
+
+
+namespace asset {
+
+std::string plugin(plugin::Plugin* plugin, std::string filename) {
+	return filename;
+}
+
+std::string user(std::string filename) {
+	return filename;
+}
+
+} // namespace asset
+
+
+static engine::Engine mockEngine;
+static window::Window mockWindow;
+static Context mockContext;
+
+Context* contextGet() {
+	mockContext.engine = &mockEngine;
+	mockContext.window = &mockWindow;
+	return &mockContext;
+}
+
+
+} // namespace rack
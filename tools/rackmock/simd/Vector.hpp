@@ -0,0 +1,151 @@
+#pragma once
+#include <cstring>
+#include <cstdint>
+#include <pmmintrin.h>
+#include <smmintrin.h>
+
+
+namespace rack {
+namespace simd {
+
+
+template <typename T, int N>
+struct Vector;
+
+
+template <>
+struct Vector<float, 4> {
+	using type = float;
+	constexpr static int size = 4;
+
+	union {
+		__m128 v;
+		float s[4];
+	};
+
+	Vector() = default;
+	Vector(__m128 v) : v(v) {}
+	Vector(float x) { v = _mm_set1_ps(x); }
+	Vector(float x1, float x2, float x3, float x4) { v = _mm_setr_ps(x1, x2, x3, x4); }
+	static Vector zero() { return Vector(_mm_setzero_ps()); }
+	static Vector mask() { return Vector(_mm_castsi128_ps(_mm_set1_epi32(-1))); }
+	static Vector load(const float* x) { return Vector(_mm_loadu_ps(x)); }
+	void store(float* x) { _mm_storeu_ps(x, v); }
+	static Vector cast(Vector<int32_t, 4> a);
+	Vector(Vector<int32_t, 4> a);
+	float& operator[](int i) { return s[i]; }
+	const float& operator[](int i) const { return s[i]; }
+};
+
+
+template <>
+struct Vector<int32_t, 4> {
+	using type = int32_t;
+	constexpr static int size = 4;
+
+	union {
+		__m128i v;
+		int32_t s[4];
+	};
+
+	Vector() = default;
+	Vector(__m128i v) : v(v) {}
+	Vector(int32_t x) { v = _mm_set1_epi32(x); }
+	Vector(int32_t x1, int32_t x2, int32_t x3, int32_t x4) { v = _mm_setr_epi32(x1, x2, x3, x4); }
+	static Vector zero() { return Vector(_mm_setzero_si128()); }
+	static Vector mask() { return Vector(_mm_set1_epi32(-1)); }
+	static Vector load(const int32_t* x) { return Vector(_mm_loadu_si128((const __m128i*) x)); }
+	void store(int32_t* x) { _mm_storeu_si128((__m128i*) x, v); }
+	static Vector cast(Vector<float, 4> a) { return Vector(_mm_castps_si128(a.v)); }
+	Vector(Vector<float, 4> a) { v = _mm_cvttps_epi32(a.v); }
+	int32_t& operator[](int i) { return s[i]; }
+	const int32_t& operator[](int i) const { return s[i]; }
+};
+
+
+inline Vector<float, 4>::Vector(Vector<int32_t, 4> a) { v = _mm_cvtepi32_ps(a.v); }
+inline Vector<float, 4> Vector<float, 4>::cast(Vector<int32_t, 4> a) { return Vector(_mm_castsi128_ps(a.v)); }
+
+
+typedef Vector<float, 4> float_4;
+typedef Vector<int32_t, 4> int32_4;
+
+
+#define ZC_MOCK_FOP(op, fn) \
+	inline float_4 operator op(const float_4& a, const float_4& b) { return float_4(fn(a.v, b.v)); }
+ZC_MOCK_FOP(+, _mm_add_ps)
+ZC_MOCK_FOP(-, _mm_sub_ps)
+ZC_MOCK_FOP(*, _mm_mul_ps)
+ZC_MOCK_FOP(/, _mm_div_ps)
+ZC_MOCK_FOP(&, _mm_and_ps)
+ZC_MOCK_FOP(|, _mm_or_ps)
+ZC_MOCK_FOP(^, _mm_xor_ps)
+ZC_MOCK_FOP(==, _mm_cmpeq_ps)
+ZC_MOCK_FOP(>=, _mm_cmpge_ps)
+ZC_MOCK_FOP(>, _mm_cmpgt_ps)
+ZC_MOCK_FOP(<=, _mm_cmple_ps)
+ZC_MOCK_FOP(<, _mm_cmplt_ps)
+ZC_MOCK_FOP(!=, _mm_cmpneq_ps)
+#undef ZC_MOCK_FOP
+
+#define ZC_MOCK_IOP(op, fn) \
+	inline int32_4 operator op(const int32_4& a, const int32_4& b) { return int32_4(fn(a.v, b.v)); }
+ZC_MOCK_IOP(+, _mm_add_epi32)
+ZC_MOCK_IOP(-, _mm_sub_epi32)
+ZC_MOCK_IOP(*, _mm_mullo_epi32)
+ZC_MOCK_IOP(&, _mm_and_si128)
+ZC_MOCK_IOP(|, _mm_or_si128)
+ZC_MOCK_IOP(^, _mm_xor_si128)
+ZC_MOCK_IOP(==, _mm_cmpeq_epi32)
+ZC_MOCK_IOP(>, _mm_cmpgt_epi32)
+ZC_MOCK_IOP(<, _mm_cmplt_epi32)
+#undef ZC_MOCK_IOP
+
+#define ZC_MOCK_COMPOUND(T, op) \
+	inline T& operator op##=(T& a, const T& b) { return a = a op b; }
+ZC_MOCK_COMPOUND(float_4, +)
+ZC_MOCK_COMPOUND(float_4, -)
+ZC_MOCK_COMPOUND(float_4, *)
+ZC_MOCK_COMPOUND(float_4, /)
+ZC_MOCK_COMPOUND(float_4, &)
+ZC_MOCK_COMPOUND(float_4, |)
+ZC_MOCK_COMPOUND(float_4, ^)
+ZC_MOCK_COMPOUND(int32_4, +)
+ZC_MOCK_COMPOUND(int32_4, -)
+ZC_MOCK_COMPOUND(int32_4, *)
+ZC_MOCK_COMPOUND(int32_4, &)
+ZC_MOCK_COMPOUND(int32_4, |)
+ZC_MOCK_COMPOUND(int32_4, ^)
+#undef ZC_MOCK_COMPOUND
+
+// Scalar-on-either-side overloads, as in Rack's simd headers.
+#define ZC_MOCK_SCALAR(T, S, op) \
+	inline T operator op(const T& a, S b) { return a op T(b); } \
+	inline T operator op(S a, const T& b) { return T(a) op b; }
+ZC_MOCK_SCALAR(float_4, float, +)
+ZC_MOCK_SCALAR(float_4, float, -)
+ZC_MOCK_SCALAR(float_4, float, *)
+ZC_MOCK_SCALAR(float_4, float, /)
+ZC_MOCK_SCALAR(float_4, float, ==)
+ZC_MOCK_SCALAR(float_4, float, >=)
+ZC_MOCK_SCALAR(float_4, float, >)
+ZC_MOCK_SCALAR(float_4, float, <=)
+ZC_MOCK_SCALAR(float_4, float, <)
+ZC_MOCK_SCALAR(float_4, float, !=)
+ZC_MOCK_SCALAR(int32_4, int32_t, +)
+ZC_MOCK_SCALAR(int32_4, int32_t, -)
+ZC_MOCK_SCALAR(int32_4, int32_t, *)
+ZC_MOCK_SCALAR(int32_4, int32_t, &)
+ZC_MOCK_SCALAR(int32_4, int32_t, |)
+ZC_MOCK_SCALAR(int32_4, int32_t, ==)
+#undef ZC_MOCK_SCALAR
+
+inline float_4 operator-(const float_4& a) { return 0.f - a; }
+inline float_4 operator~(const float_4& a) { return a ^ float_4::mask(); }
+inline int32_4 operator~(const int32_4& a) { return a ^ int32_4::mask(); }
+inline int32_4 operator<<(const int32_4& a, int b) { return int32_4(_mm_slli_epi32(a.v, b)); }
+inline int32_4 operator>>(const int32_4& a, int b) { return int32_4(_mm_srai_epi32(a.v, b)); }
+
+
+} // namespace simd
+} // namespace rack
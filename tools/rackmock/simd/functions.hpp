@@ -0,0 +1,68 @@
+#pragma once
+#include <cmath>
+#include <simd/Vector.hpp>
+
+
+namespace rack {
+namespace simd {
+
+
+// Scalar fallbacks, so generic code can be instantiated with T = float.
+using std::floor;
+using std::ceil;
+using std::round;
+using std::trunc;
+using std::fmin;
+using std::fmax;
+using std::sqrt;
+using std::fabs;
+using std::exp;
+using std::log;
+using std::sin;
+using std::cos;
+using std::pow;
+
+inline float ifelse(bool cond, float a, float b) { return cond ? a : b; }
+inline int movemask(bool a) { return a ? 1 : 0; }
+
+inline float_4 ifelse(float_4 mask, float_4 a, float_4 b) { return (mask & a) | (~mask & b); }
+inline int movemask(float_4 a) { return _mm_movemask_ps(a.v); }
+inline int movemask(int32_4 a) { return _mm_movemask_ps(_mm_castsi128_ps(a.v)); }
+
+inline float_4 floor(float_4 a) { return float_4(_mm_floor_ps(a.v)); }
+inline float_4 ceil(float_4 a) { return float_4(_mm_ceil_ps(a.v)); }
+inline float_4 round(float_4 a) { return float_4(_mm_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)); }
+inline float_4 trunc(float_4 a) { return float_4(_mm_round_ps(a.v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)); }
+inline float_4 fmin(float_4 a, float_4 b) { return float_4(_mm_min_ps(a.v, b.v)); }
+inline float_4 fmax(float_4 a, float_4 b) { return float_4(_mm_max_ps(a.v, b.v)); }
+inline float_4 sqrt(float_4 a) { return float_4(_mm_sqrt_ps(a.v)); }
+inline float_4 fabs(float_4 a) { return float_4(_mm_andnot_ps(_mm_set1_ps(-0.f), a.v)); }
+inline float_4 abs(float_4 a) { return fabs(a); }
+inline float_4 clamp(float_4 x, float_4 a, float_4 b) { return fmin(fmax(x, a), b); }
+
+#define ZC_MOCK_LANEWISE(fn) \
+	inline float_4 fn(float_4 a) { return float_4(std::fn(a[0]), std::fn(a[1]), std::fn(a[2]), std::fn(a[3])); }
+ZC_MOCK_LANEWISE(exp)
+ZC_MOCK_LANEWISE(log)
+ZC_MOCK_LANEWISE(sin)
+ZC_MOCK_LANEWISE(cos)
+#undef ZC_MOCK_LANEWISE
+
+inline float_4 pow(float_4 a, float_4 b) {
+	return float_4(std::pow(a[0], b[0]), std::pow(a[1], b[1]), std::pow(a[2], b[2]), std::pow(a[3], b[3]));
+}
+inline float_4 pow(float a, float_4 b) { return pow(float_4(a), b); }
+
+template <typename T>
+T rescale(T x, T xMin, T xMax, T yMin, T yMax) {
+	return yMin + (x - xMin) / (xMax - xMin) * (yMax - yMin);
+}
+
+template <typename T>
+T crossfade(T a, T b, T p) {
+	return a + (b - a) * p;
+}
+
+
+} // namespace simd
+} // namespace rack
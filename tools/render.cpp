@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+// Offline renderer: runs one module for a fixed time with scripted knob and
+// CV values, as fast as it will go, and writes its outputs to a float WAV or
+// raw file. With --compare it checks the render against a stored golden file
+// instead, so optimised kernels can be checked against reference output.
+//
+//   render SLUG [options]
+//     --seconds S          length of the render (default 1)
+//     --rate HZ            sample rate (default 48000)
+//     --channels N         polyphony of every patched input (default 1)
+//     --seed N             seed for the module's random stream (default 1)
+//     --param ID=V[@T]     set knob ID to V, at time T seconds (default 0)
+//     --input ID=V[@T]     hold input ID at V volts, from time T
+//     --input ID=V,V,...[@T]  the same with a voltage per channel, repeating
+//                          if there are fewer than channels
+//     --input ID=sine:HZ[:AMP] or ID=square:HZ[:AMP]
+//                          drive input ID with a waveform (AMP volts peak, default 5)
+//     --data KEY=VALUE     module setting as in the patch file, e.g. busmode=2
+//     --output ID          record only this output (repeatable; default all)
+//     --out FILE           write .wav (32 bit float) or raw interleaved floats
+//     --compare FILE       compare with a golden .wav or raw file instead
+//     --tolerance T        max abs difference allowed by --compare (default 1e-4)
+//     --kernels NAME       run the DSP kernels built for NAME (default the widest
+//                          this CPU runs); render --list-kernels lists them
+//
+// Frames are interleaved output-major: for each sample, every channel of the
+// first recorded output, then the next output.
+#include "harness.hpp"
+#include "dsp/Kernels.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+struct ParamEvent {
+	int id;
+	float value;
+	float time;
+};
+
+struct InputSource {
+	enum Shape { CONSTANT, SINE, SQUARE };
+	int id;
+	Shape shape = CONSTANT;
+	float value = 0.f;
+	std::vector<float> values; // per channel, for CONSTANT
+	float freq = 0.f;
+	float time = 0.f;
+};
+
+static bool splitAssignment(const std::string& arg, std::string& key, std::string& value) {
+	size_t eq = arg.find('=');
+	if (eq == std::string::npos)
+		return false;
+	key = arg.substr(0, eq);
+	value = arg.substr(eq + 1);
+	return true;
+}
+
+// Splits "V@T" into the value and its start time.
+static std::string splitTime(const std::string& value, float& time) {
+	size_t at = value.find('@');
+	time = at == std::string::npos ? 0.f : std::atof(value.c_str() + at + 1);
+	return value.substr(0, at);
+}
+
+static json_t* parseJsonValue(const std::string& value) {
+	if (value == "true")
+		return json_true();
+	if (value == "false")
+		return json_false();
+	char* end;
+	long long i = std::strtoll(value.c_str(), &end, 10);
+	if (*end == '\0')
+		return json_integer(i);
+	double d = std::strtod(value.c_str(), &end);
+	if (*end == '\0')
+		return json_real(d);
+	return json_string(value.c_str());
+}
+
+static bool writeFile(const std::string& path, const std::vector<float>& frames, int width, int sampleRate) {
+	FILE* f = std::fopen(path.c_str(), "wb");
+	if (!f)
+		return false;
+	bool wav = path.size() > 4 && path.compare(path.size() - 4, 4, ".wav") == 0;
+	if (wav) {
+		uint32_t dataBytes = frames.size()*sizeof(float);
+		uint32_t riffBytes = 36 + dataBytes;
+		uint32_t fmtBytes = 16;
+		uint16_t format = 3; // IEEE float
+		uint16_t channels = width;
+		uint32_t rate = sampleRate;
+		uint32_t byteRate = rate*width*sizeof(float);
+		uint16_t blockAlign = width*sizeof(float);
+		uint16_t bits = 32;
+		std::fwrite("RIFF", 1, 4, f);
+		std::fwrite(&riffBytes, 4, 1, f);
+		std::fwrite("WAVEfmt ", 1, 8, f);
+		std::fwrite(&fmtBytes, 4, 1, f);
+		std::fwrite(&format, 2, 1, f);
+		std::fwrite(&channels, 2, 1, f);
+		std::fwrite(&rate, 4, 1, f);
+		std::fwrite(&byteRate, 4, 1, f);
+		std::fwrite(&blockAlign, 2, 1, f);
+		std::fwrite(&bits, 2, 1, f);
+		std::fwrite("data", 1, 4, f);
+		std::fwrite(&dataBytes, 4, 1, f);
+	}
+	std::fwrite(frames.data(), sizeof(float), frames.size(), f);
+	std::fclose(f);
+	return true;
+}
+
+// Reads raw floats, or the data chunk of a float WAV.
+static bool readFile(const std::string& path, std::vector<float>& frames) {
+	FILE* f = std::fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+	std::vector<char> bytes;
+	char buffer[65536];
+	size_t n;
+	while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0)
+		bytes.insert(bytes.end(), buffer, buffer + n);
+	std::fclose(f);
+
+	size_t offset = 0;
+	size_t size = bytes.size();
+	if (size >= 12 && !std::memcmp(&bytes[0], "RIFF", 4) && !std::memcmp(&bytes[8], "WAVE", 4)) {
+		size_t pos = 12;
+		size = 0;
+		while (pos + 8 <= bytes.size()) {
+			uint32_t chunkBytes;
+			std::memcpy(&chunkBytes, &bytes[pos + 4], 4);
+			if (!std::memcmp(&bytes[pos], "data", 4)) {
+				offset = pos + 8;
+				size = std::min((size_t) chunkBytes, bytes.size() - offset);
+				break;
+			}
+			pos += 8 + chunkBytes + (chunkBytes & 1);
+		}
+	}
+	frames.resize(size/sizeof(float));
+	if (!frames.empty())
+		std::memcpy(frames.data(), &bytes[offset], frames.size()*sizeof(float));
+	return true;
+}
+
+static int usage(const char* name) {
+	std::fprintf(stderr, "usage: %s SLUG [--seconds S] [--rate HZ] [--channels N] [--seed N] [--param ID=V[@T]]\n"
+		"       [--input ID=V[,V...][@T]|ID=sine:HZ[:AMP]|ID=square:HZ[:AMP]] [--data KEY=VALUE] [--output ID]\n"
+		"       [--out FILE | --compare FILE [--tolerance T]] [--kernels NAME]\n"
+		"       %s --list-kernels\n", name, name);
+	return 2;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2)
+		return usage(argv[0]);
+	const zcdsp::Kernels* kernelSets[8];
+	int kernelCount = zcdsp::supportedKernels(kernelSets, 8);
+	if (std::strcmp(argv[1], "--list-kernels") == 0) {
+		for (int k = 0; k < kernelCount; k++)
+			std::printf("%s\n", kernelSets[k]->name);
+		return 0;
+	}
+	Model* model = harness::findModel(argv[1]);
+	if (!model) {
+		std::fprintf(stderr, "unknown module %s; available:", argv[1]);
+		for (Model* m : harness::loadPlugin()->models)
+			std::fprintf(stderr, " %s", m->slug.c_str());
+		std::fprintf(stderr, "\n");
+		return 2;
+	}
+
+	float seconds = 1.f;
+	float sampleRate = 48000.f;
+	int channels = 1;
+	long long seed = 1;
+	float tolerance = 1e-4f;
+	std::vector<ParamEvent> paramEvents;
+	std::vector<InputSource> sources;
+	std::vector<int> recorded;
+	json_t* dataJ = json_object();
+	std::string outPath, comparePath, kernelName;
+
+	for (int i = 2; i < argc; i++) {
+		std::string opt = argv[i];
+		if (i + 1 >= argc)
+			return usage(argv[0]);
+		std::string arg = argv[++i];
+		std::string key, value;
+		if (opt == "--seconds")
+			seconds = std::atof(arg.c_str());
+		else if (opt == "--rate")
+			sampleRate = std::atof(arg.c_str());
+		else if (opt == "--channels")
+			channels = clamp(std::atoi(arg.c_str()), 1, 16);
+		else if (opt == "--seed")
+			seed = std::atoll(arg.c_str());
+		else if (opt == "--tolerance")
+			tolerance = std::atof(arg.c_str());
+		else if (opt == "--output")
+			recorded.push_back(std::atoi(arg.c_str()));
+		else if (opt == "--out")
+			outPath = arg;
+		else if (opt == "--compare")
+			comparePath = arg;
+		else if (opt == "--kernels")
+			kernelName = arg;
+		else if (opt == "--param" && splitAssignment(arg, key, value)) {
+			ParamEvent e;
+			e.id = std::atoi(key.c_str());
+			e.value = std::atof(splitTime(value, e.time).c_str());
+			paramEvents.push_back(e);
+		}
+		else if (opt == "--input" && splitAssignment(arg, key, value)) {
+			InputSource s;
+			s.id = std::atoi(key.c_str());
+			if (value.compare(0, 5, "sine:") == 0 || value.compare(0, 7, "square:") == 0) {
+				s.shape = value[1] == 'i' ? InputSource::SINE : InputSource::SQUARE;
+				const char* p = std::strchr(value.c_str(), ':') + 1;
+				s.freq = std::atof(p);
+				const char* amp = std::strchr(p, ':');
+				s.value = amp ? std::atof(amp + 1) : 5.f;
+			}
+			else {
+				std::string list = splitTime(value, s.time);
+				for (size_t p = 0; p != std::string::npos; ) {
+					size_t comma = list.find(',', p);
+					s.values.push_back(std::atof(list.substr(p, comma - p).c_str()));
+					p = comma == std::string::npos ? comma : comma + 1;
+				}
+			}
+			sources.push_back(s);
+		}
+		else if (opt == "--data" && splitAssignment(arg, key, value))
+			json_object_set_new(dataJ, key.c_str(), parseJsonValue(value));
+		else
+			return usage(argv[0]);
+	}
+
+	if (!kernelName.empty()) {
+		int k = 0;
+		while (k < kernelCount && kernelName != kernelSets[k]->name)
+			k++;
+		if (k == kernelCount) {
+			std::fprintf(stderr, "kernel set %s not available here\n", kernelName.c_str());
+			return 2;
+		}
+		zcdsp::kernels = *kernelSets[k];
+	}
+
+	// seed both the module's stream and the shared generator it was constructed from
+	random::seed(seed);
+	harness::setSampleRate(sampleRate);
+	Module* module = model->createModule();
+	module->onSampleRateChange();
+	json_object_set_new(dataJ, "seed", json_integer(seed));
+	module->dataFromJson(dataJ);
+	json_decref(dataJ);
+	harness::connectOutputs(module);
+	if (recorded.empty())
+		for (size_t o = 0; o < module->outputs.size(); o++)
+			recorded.push_back(o);
+	for (int o : recorded) {
+		if (o < 0 || o >= (int) module->outputs.size()) {
+			std::fprintf(stderr, "%s has no output %d\n", model->slug.c_str(), o);
+			return 2;
+		}
+	}
+	for (const InputSource& s : sources) {
+		if (s.id < 0 || s.id >= (int) module->inputs.size()) {
+			std::fprintf(stderr, "%s has no input %d\n", model->slug.c_str(), s.id);
+			return 2;
+		}
+		module->inputs[s.id].channels = channels;
+	}
+	for (const ParamEvent& e : paramEvents) {
+		if (e.id < 0 || e.id >= (int) module->params.size()) {
+			std::fprintf(stderr, "%s has no param %d\n", model->slug.c_str(), e.id);
+			return 2;
+		}
+	}
+
+	int64_t length = (int64_t) (seconds*sampleRate);
+	Module::ProcessArgs args = harness::processArgs(sampleRate);
+	std::vector<float> frames;
+	frames.reserve(length*recorded.size()*channels);
+	auto start = std::chrono::steady_clock::now();
+	for (int64_t s = 0; s < length; s++) {
+		float t = s/sampleRate;
+		for (const ParamEvent& e : paramEvents)
+			if (e.time <= t)
+				module->params[e.id].setValue(e.value);
+		for (const InputSource& src : sources) {
+			Input& input = module->inputs[src.id];
+			float v;
+			if (src.shape == InputSource::SINE)
+				v = src.value*std::sin(2.0*M_PI*src.freq*s/sampleRate);
+			else if (src.shape == InputSource::SQUARE)
+				v = std::fmod(src.freq*s/sampleRate, 1.0) < 0.5 ? src.value : 0.f;
+			else if (src.time <= t) {
+				for (int c = 0; c < channels; c++)
+					input.voltages[c] = src.values[c % src.values.size()];
+				continue;
+			}
+			else
+				continue;
+			for (int c = 0; c < channels; c++)
+				input.voltages[c] = v;
+		}
+		module->process(args);
+		args.frame++;
+		for (int o : recorded) {
+			Output& output = module->outputs[o];
+			for (int c = 0; c < channels; c++)
+				frames.push_back(output.voltages[c]);
+		}
+	}
+	double elapsed = harness::secondsSince(start);
+	delete module;
+	int width = recorded.size()*channels;
+	std::fprintf(stderr, "%s: %lld samples in %.3f s (%.0fx real time)\n", model->slug.c_str(),
+		(long long) length, elapsed, elapsed > 0 ? seconds/elapsed : 0.0);
+
+	if (!comparePath.empty()) {
+		std::vector<float> golden;
+		if (!readFile(comparePath, golden)) {
+			std::fprintf(stderr, "cannot read %s\n", comparePath.c_str());
+			return 2;
+		}
+		if (golden.size() != frames.size()) {
+			std::fprintf(stderr, "FAIL %s: %zu values, golden has %zu\n", comparePath.c_str(), frames.size(), golden.size());
+			return 1;
+		}
+		double maxError = 0.0, sumSquares = 0.0;
+		size_t worst = 0;
+		for (size_t i = 0; i < frames.size(); i++) {
+			double e = std::fabs((double) frames[i] - golden[i]);
+			if (!(e <= maxError)) {
+				maxError = e;
+				worst = i;
+			}
+			sumSquares += e*e;
+		}
+		double rms = frames.empty() ? 0.0 : std::sqrt(sumSquares/frames.size());
+		bool pass = maxError <= tolerance;
+		std::printf("%s %s: max error %.3g at sample %zu column %zu, rms %.3g\n", pass ? "ok  " : "FAIL",
+			comparePath.c_str(), maxError, worst/width, worst%width, rms);
+		return pass ? 0 : 1;
+	}
+	if (!outPath.empty() && !writeFile(outPath, frames, width, (int) sampleRate)) {
+		std::fprintf(stderr, "cannot write %s\n", outPath.c_str());
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,507 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+// Parameter-space sweep of the chaotic oscillators: runs RosslerRustler or
+// Firefly over a 2-D grid of two knobs, in parallel on every core, and reports
+// cheap summary metrics per cell:
+//   lyapunov   largest Lyapunov exponent in 1/s, from a twin trajectory kept
+//              a small distance away and renormalised (Benettin's method)
+//   frequency  upward zero crossings per second of the output
+//   clamp      fraction of samples where the module's clamp is hit (any of
+//              x, y, z at +-20 for RosslerRustler, the +-5 V output for Firefly)
+//   order      mean Kuramoto order parameter |sum exp(i theta)|/5 of the five
+//              Firefly phases; nan for RosslerRustler
+// Each cell is a fresh start from the module's initial state, with the twin on
+// channel 1 and the reference on channel 0, both at the --pitch V/oct.
+//
+//   sweep SLUG [options]
+//     --x ID=MIN:MAX       knob on the horizontal axis
+//     --y ID=MIN:MAX       knob on the vertical axis
+//     --param ID=V         hold another knob at V
+//     --size N or WxH      grid size (default 64)
+//     --seconds S          measured time per cell (default 0.5)
+//     --settle S           time run before measuring (default 0.1)
+//     --rate HZ            sample rate (default 48000)
+//     --pitch V            V/oct input of both channels (default 0)
+//     --threads N          worker threads (default all cores)
+//     --csv OUT            one row per cell: x,y,lyapunov,frequency,clamp,order
+//     --ppm OUT            heat map of --metric, y increasing upwards
+//     --metric NAME        lyapunov, frequency, clamp or order (default lyapunov)
+//     --range MIN:MAX      colour range of the heat map (default the metric's extent)
+//
+// The modules' sources are compiled into the tool so the sweep can read their
+// state; renaming the models keeps them apart from the plugin's own objects.
+#include "harness.hpp"
+#define modelRosslerRustler sweepModelRosslerRustler
+#define modelFirefly sweepModelFirefly
+#include "../src/RosslerRustler.cpp"
+#include "../src/Firefly.cpp"
+#undef modelRosslerRustler
+#undef modelFirefly
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const float perturbation = 1e-4f;
+static const int renormaliseEvery = 64;
+
+struct Axis {
+	int id = -1;
+	float min = 0.f;
+	float max = 1.f;
+	int steps = 64;
+
+	Axis() {}
+	Axis(int id, float min, float max) : id(id), min(min), max(max) {}
+
+	float at(int i) const {
+		return steps > 1 ? min + (max - min)*i/(steps - 1) : min;
+	}
+};
+
+struct Metrics {
+	double lyapunov = NAN;
+	double frequency = NAN;
+	double clamp = NAN;
+	double order = NAN;
+};
+
+struct Settings {
+	Axis x, y;
+	std::vector<std::pair<int, float>> fixed;
+	float seconds = 0.5f;
+	float settle = 0.1f;
+	float sampleRate = 48000.f;
+	float pitch = 0.f;
+};
+
+// The twin trajectory and metric hooks of each swept module: reset() restores
+// the initial state, displace() puts channel 1 a perturbation away from
+// channel 0, separation() is the distance between the channels and
+// renormalise() pulls channel 1 back towards channel 0 by a factor.
+struct RosslerSystem {
+	typedef RosslerRustlerModule M;
+	std::unique_ptr<M> module{new M};
+
+	void reset() {
+		for (int c = 0; c < 2; c++) {
+			module->rossler.x[c] = 0.f;
+			module->rossler.y[c] = 5.f;
+			module->rossler.z[c] = 0.f;
+		}
+		module->knobs = ParamRamps<M::NUM_PARAMS>();
+	}
+
+	void displace() {
+		module->rossler.x[1] = module->rossler.x[0] + perturbation;
+		module->rossler.y[1] = module->rossler.y[0];
+		module->rossler.z[1] = module->rossler.z[0];
+	}
+
+	double separation() const {
+		double dx = module->rossler.x[1] - module->rossler.x[0];
+		double dy = module->rossler.y[1] - module->rossler.y[0];
+		double dz = module->rossler.z[1] - module->rossler.z[0];
+		return std::sqrt(dx*dx + dy*dy + dz*dz);
+	}
+
+	void renormalise(float scale) {
+		module->rossler.x[1] = module->rossler.x[0] + (module->rossler.x[1] - module->rossler.x[0])*scale;
+		module->rossler.y[1] = module->rossler.y[0] + (module->rossler.y[1] - module->rossler.y[0])*scale;
+		module->rossler.z[1] = module->rossler.z[0] + (module->rossler.z[1] - module->rossler.z[0])*scale;
+	}
+
+	bool clamped() const {
+		return std::fabs(module->rossler.x[0]) >= 20.f || std::fabs(module->rossler.y[0]) >= 20.f || std::fabs(module->rossler.z[0]) >= 20.f;
+	}
+
+	double order() const {
+		return NAN;
+	}
+
+	int pitchInput() const {
+		return M::PITCH_INPUT;
+	}
+};
+
+struct FireflySystem {
+	typedef FireflyModule M;
+	std::unique_ptr<M> module{new M};
+
+	void reset() {
+		for (int c = 0; c < 2; c++)
+			for (int i = 0; i < 5; i++)
+				module->bank.theta[c][i] = 0.f;
+		module->knobs = ParamRamps<M::NUM_PARAMS>();
+		module->ctrlScheduler.counter = 0;
+		module->ctrlScheduler.nextSlot = 0;
+	}
+
+	void displace() {
+		for (int i = 0; i < 5; i++)
+			module->bank.theta[1][i] = module->bank.theta[0][i];
+		module->bank.theta[1][0] = std::fmod(module->bank.theta[0][0] + perturbation, 6.2831853f);
+	}
+
+	static float phaseDifference(float a, float b) {
+		float d = a - b;
+		return d - std::round(d/6.2831853f)*6.2831853f;
+	}
+
+	double separation() const {
+		double sum = 0.0;
+		for (int i = 0; i < 5; i++) {
+			double d = phaseDifference(module->bank.theta[1][i], module->bank.theta[0][i]);
+			sum += d*d;
+		}
+		return std::sqrt(sum);
+	}
+
+	void renormalise(float scale) {
+		for (int i = 0; i < 5; i++) {
+			float theta = module->bank.theta[0][i] + phaseDifference(module->bank.theta[1][i], module->bank.theta[0][i])*scale;
+			module->bank.theta[1][i] = theta - std::floor(theta/6.2831853f)*6.2831853f;
+		}
+	}
+
+	bool clamped() const {
+		return std::fabs(module->outputs[M::SM_OUTPUT].getVoltage(0)) >= 5.f;
+	}
+
+	double order() const {
+		double re = 0.0, im = 0.0;
+		for (int i = 0; i < 5; i++) {
+			re += std::cos(module->bank.theta[0][i]);
+			im += std::sin(module->bank.theta[0][i]);
+		}
+		return std::sqrt(re*re + im*im)/5.0;
+	}
+
+	int pitchInput() const {
+		return M::VOCT_INPUT;
+	}
+};
+
+template <typename S>
+static Metrics simulate(S& system, const Settings& settings, float xValue, float yValue) {
+	Module* module = system.module.get();
+	for (const std::pair<int, float>& p : settings.fixed)
+		module->params[p.first].setValue(p.second);
+	module->params[settings.x.id].setValue(xValue);
+	module->params[settings.y.id].setValue(yValue);
+	Input& pitch = module->inputs[system.pitchInput()];
+	pitch.channels = 2;
+	pitch.voltages[0] = pitch.voltages[1] = settings.pitch;
+	harness::connectOutputs(module, 2);
+	system.reset();
+	system.displace();
+
+	Module::ProcessArgs args = harness::processArgs(settings.sampleRate);
+	int settleSamples = (int) (settings.settle*settings.sampleRate);
+	int samples = std::max((int) (settings.seconds*settings.sampleRate), renormaliseEvery);
+	std::vector<float> out(samples);
+	double logGrowth = 0.0, order = 0.0;
+	int clampHits = 0, orderSamples = 0, windows = 0;
+	for (int s = -settleSamples; s < samples; s++) {
+		module->process(args);
+		args.frame++;
+		if (s >= 0) {
+			out[s] = module->outputs[0].getVoltage(0);
+			clampHits += system.clamped();
+			if (s % 8 == 0) {
+				order += system.order();
+				orderSamples++;
+			}
+		}
+		// the twin also runs through the settling time, so it has turned
+		// towards the most unstable direction by the time growth is counted
+		if ((s + settleSamples + 1) % renormaliseEvery == 0) {
+			double d = system.separation();
+			// a twin that collapsed onto the reference (both clamped, or below
+			// float resolution) counts as strong contraction and is displaced again
+			double floor = perturbation*1e-6;
+			if (s >= 0) {
+				logGrowth += std::log(std::max(d, floor)/perturbation);
+				windows++;
+			}
+			if (d > floor)
+				system.renormalise(perturbation/d);
+			else
+				system.displace();
+		}
+	}
+
+	Metrics metrics;
+	metrics.lyapunov = windows > 0 ? logGrowth/((double) windows*renormaliseEvery/settings.sampleRate) : NAN;
+	metrics.clamp = (double) clampHits/samples;
+	metrics.order = order/orderSamples;
+
+	// zero crossings about the mean, with a hysteresis of a tenth of the deviation
+	double mean = 0.0, deviation = 0.0;
+	for (float v : out)
+		mean += v;
+	mean /= samples;
+	for (float v : out)
+		deviation += (v - mean)*(v - mean);
+	float hysteresis = 0.1f*std::sqrt(deviation/samples);
+	int crossings = 0;
+	bool high = out[0] > mean;
+	for (float v : out) {
+		if (!high && v > mean + hysteresis) {
+			high = true;
+			crossings++;
+		}
+		else if (high && v < mean - hysteresis)
+			high = false;
+	}
+	metrics.frequency = hysteresis > 0.f ? crossings/(samples/settings.sampleRate) : 0.0;
+	return metrics;
+}
+
+// Cells are dealt out in contiguous runs, one deque per worker. A worker takes
+// cells from the front of its own deque and, once that is empty, steals from
+// the back of the others, so the chaotic cells that run long don't leave the
+// other cores idle at the end. No cells are added after the start, so a
+// worker that finds every deque empty is done.
+struct WorkQueue {
+	std::mutex mutex;
+	std::deque<int> cells;
+};
+
+template <typename S>
+static void runSweep(const Settings& settings, std::vector<Metrics>& results, int threadCount) {
+	int total = settings.x.steps*settings.y.steps;
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	for (int t = 0; t < threadCount; t++) {
+		queues.emplace_back(new WorkQueue);
+		for (int i = (int64_t) total*t/threadCount; i < (int64_t) total*(t + 1)/threadCount; i++)
+			queues[t]->cells.push_back(i);
+	}
+
+	std::atomic<int> done(0);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threadCount; t++) {
+		workers.push_back(std::thread([&, t]() {
+			S system;
+			while (true) {
+				int cell = -1;
+				for (int k = 0; k < threadCount && cell < 0; k++) {
+					WorkQueue& queue = *queues[(t + k) % threadCount];
+					std::lock_guard<std::mutex> lock(queue.mutex);
+					if (queue.cells.empty())
+						continue;
+					if (k == 0) {
+						cell = queue.cells.front();
+						queue.cells.pop_front();
+					}
+					else {
+						cell = queue.cells.back();
+						queue.cells.pop_back();
+					}
+				}
+				if (cell < 0)
+					break;
+				int i = cell % settings.x.steps, j = cell/settings.x.steps;
+				results[cell] = simulate(system, settings, settings.x.at(i), settings.y.at(j));
+				done++;
+			}
+		}));
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	while (done < total) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		int n = done;
+		double elapsed = harness::secondsSince(start);
+		std::fprintf(stderr, "\r%d/%d cells, %.0f s elapsed, %.0f s left   ", n, total, elapsed,
+			n > 0 ? elapsed*(total - n)/n : 0.0);
+	}
+	std::fprintf(stderr, "\n");
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+static double metricValue(const Metrics& m, const std::string& name) {
+	if (name == "frequency")
+		return m.frequency;
+	if (name == "clamp")
+		return m.clamp;
+	if (name == "order")
+		return m.order;
+	return m.lyapunov;
+}
+
+// black through purple, red and orange to pale yellow
+static void heatColour(double t, unsigned char* rgb) {
+	static const float stops[5][3] = {{0, 0, 4}, {87, 16, 110}, {188, 55, 84}, {249, 142, 9}, {252, 255, 164}};
+	t = clamp((float) t, 0.f, 1.f)*4.f;
+	int k = std::min((int) t, 3);
+	float f = t - k;
+	for (int i = 0; i < 3; i++)
+		rgb[i] = (unsigned char) std::round(stops[k][i] + (stops[k + 1][i] - stops[k][i])*f);
+}
+
+static bool writePpm(const std::string& path, const Settings& settings, const std::vector<Metrics>& results,
+	const std::string& metric, float rangeMin, float rangeMax) {
+	FILE* f = std::fopen(path.c_str(), "wb");
+	if (!f)
+		return false;
+	std::fprintf(f, "P6\n%d %d\n255\n", settings.x.steps, settings.y.steps);
+	for (int j = settings.y.steps - 1; j >= 0; j--) {
+		for (int i = 0; i < settings.x.steps; i++) {
+			double v = metricValue(results[j*settings.x.steps + i], metric);
+			unsigned char rgb[3] = {128, 128, 128};
+			if (std::isfinite(v))
+				heatColour(rangeMax > rangeMin ? (v - rangeMin)/(rangeMax - rangeMin) : 0.5, rgb);
+			std::fwrite(rgb, 1, 3, f);
+		}
+	}
+	std::fclose(f);
+	return true;
+}
+
+static bool parseAxis(const std::string& arg, Axis& axis) {
+	return std::sscanf(arg.c_str(), "%d=%f:%f", &axis.id, &axis.min, &axis.max) == 3;
+}
+
+static int usage(const char* name) {
+	std::fprintf(stderr, "usage: %s RosslerRustler|Firefly [--x ID=MIN:MAX] [--y ID=MIN:MAX] [--param ID=V] [--size N|WxH]\n"
+		"       [--seconds S] [--settle S] [--rate HZ] [--pitch V] [--threads N]\n"
+		"       [--csv OUT] [--ppm OUT] [--metric lyapunov|frequency|clamp|order] [--range MIN:MAX]\n", name);
+	return 1;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2)
+		return usage(argv[0]);
+	std::string slug = argv[1];
+	bool rossler = slug == "RosslerRustler";
+	if (!rossler && slug != "Firefly")
+		return usage(argv[0]);
+
+	Settings settings;
+	// the period-doubling route in c at the classic a = b, and coupling against its curve
+	if (rossler) {
+		settings.x = Axis(RosslerRustlerModule::C_PARAM, 2.f, 20.f);
+		settings.y = Axis(RosslerRustlerModule::A_PARAM, 0.05f, 0.4f);
+	}
+	else {
+		settings.x = Axis(FireflyModule::K_PARAM, -0.2f, 0.2f);
+		settings.y = Axis(FireflyModule::KTYPE_PARAM, 0.f, 1.f);
+	}
+	int numParams = rossler ? (int) RosslerRustlerModule::NUM_PARAMS : (int) FireflyModule::NUM_PARAMS;
+	int threadCount = 0;
+	std::string csvPath, ppmPath, metric = "lyapunov";
+	float rangeMin = 0.f, rangeMax = 0.f;
+	for (int i = 2; i < argc; i++) {
+		std::string opt = argv[i];
+		if (i + 1 >= argc)
+			return usage(argv[0]);
+		std::string arg = argv[++i];
+		if (opt == "--x") {
+			if (!parseAxis(arg, settings.x))
+				return usage(argv[0]);
+		}
+		else if (opt == "--y") {
+			if (!parseAxis(arg, settings.y))
+				return usage(argv[0]);
+		}
+		else if (opt == "--param") {
+			int id;
+			float value;
+			if (std::sscanf(arg.c_str(), "%d=%f", &id, &value) != 2 || id < 0 || id >= numParams)
+				return usage(argv[0]);
+			settings.fixed.push_back(std::make_pair(id, value));
+		}
+		else if (opt == "--size") {
+			int w, h;
+			if (std::sscanf(arg.c_str(), "%dx%d", &w, &h) != 2)
+				h = w = std::atoi(arg.c_str());
+			settings.x.steps = w;
+			settings.y.steps = h;
+		}
+		else if (opt == "--seconds")
+			settings.seconds = std::atof(arg.c_str());
+		else if (opt == "--settle")
+			settings.settle = std::atof(arg.c_str());
+		else if (opt == "--rate")
+			settings.sampleRate = std::atof(arg.c_str());
+		else if (opt == "--pitch")
+			settings.pitch = std::atof(arg.c_str());
+		else if (opt == "--threads")
+			threadCount = std::atoi(arg.c_str());
+		else if (opt == "--csv")
+			csvPath = arg;
+		else if (opt == "--ppm")
+			ppmPath = arg;
+		else if (opt == "--metric")
+			metric = arg;
+		else if (opt == "--range") {
+			if (std::sscanf(arg.c_str(), "%f:%f", &rangeMin, &rangeMax) != 2)
+				return usage(argv[0]);
+		}
+		else
+			return usage(argv[0]);
+	}
+	if (settings.x.id < 0 || settings.x.id >= numParams || settings.y.id < 0 || settings.y.id >= numParams
+		|| settings.x.steps < 1 || settings.y.steps < 1 || settings.seconds <= 0.f || settings.sampleRate <= 0.f
+		|| (metric != "lyapunov" && metric != "frequency" && metric != "clamp" && metric != "order"))
+		return usage(argv[0]);
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, settings.x.steps*settings.y.steps);
+
+	// modules read the sample rate when they are constructed, in the workers
+	harness::setSampleRate(settings.sampleRate);
+	std::vector<Metrics> results(settings.x.steps*settings.y.steps);
+	auto start = std::chrono::steady_clock::now();
+	if (rossler)
+		runSweep<RosslerSystem>(settings, results, threadCount);
+	else
+		runSweep<FireflySystem>(settings, results, threadCount);
+	std::fprintf(stderr, "%s: %dx%d cells in %.1f s on %d threads\n", slug.c_str(), settings.x.steps, settings.y.steps,
+		harness::secondsSince(start), threadCount);
+
+	if (!csvPath.empty()) {
+		FILE* f = std::fopen(csvPath.c_str(), "w");
+		if (!f) {
+			std::fprintf(stderr, "cannot write %s\n", csvPath.c_str());
+			return 1;
+		}
+		std::fprintf(f, "x,y,lyapunov,frequency,clamp,order\n");
+		for (int j = 0; j < settings.y.steps; j++) {
+			for (int i = 0; i < settings.x.steps; i++) {
+				const Metrics& m = results[j*settings.x.steps + i];
+				std::fprintf(f, "%.6g,%.6g,%.6g,%.6g,%.6g,%.6g\n", settings.x.at(i), settings.y.at(j),
+					m.lyapunov, m.frequency, m.clamp, m.order);
+			}
+		}
+		std::fclose(f);
+	}
+	if (!ppmPath.empty()) {
+		if (rangeMax <= rangeMin) {
+			rangeMin = INFINITY;
+			rangeMax = -INFINITY;
+			for (const Metrics& m : results) {
+				double v = metricValue(m, metric);
+				if (std::isfinite(v)) {
+					rangeMin = std::min(rangeMin, (float) v);
+					rangeMax = std::max(rangeMax, (float) v);
+				}
+			}
+		}
+		if (!writePpm(ppmPath, settings, results, metric, rangeMin, rangeMax)) {
+			std::fprintf(stderr, "cannot write %s\n", ppmPath.c_str());
+			return 1;
+		}
+		std::fprintf(stderr, "%s: %s from %g to %g\n", ppmPath.c_str(), metric.c_str(), rangeMin, rangeMax);
+	}
+	return 0;
+}
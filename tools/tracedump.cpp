@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2020 Marshall Hampton <contact hamptonio at gmail.com>
+ */
+// Reads a .zctrace file written by a module's "Record internal state" menu
+// item. Without an output option it prints the header and any gaps left by
+// dropped frames; --csv writes one row per frame and channel, --npy writes a
+// NumPy structured array with the frame layout (sample, channels, values[16][fields]).
+// Frames have a fixed size, so --first and --count seek straight to a range.
+//
+//   tracedump FILE [--first N] [--count N] [--csv OUT | --npy OUT]
+#include "Trace.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static int usage(const char* name) {
+	std::fprintf(stderr, "usage: %s FILE [--first N] [--count N] [--csv OUT | --npy OUT]\n", name);
+	return 1;
+}
+
+static void writeNpyHeader(FILE* f, const TraceHeader& header, uint64_t frames) {
+	std::string dict = string::f("{'descr': [('sample', '<u8'), ('channels', '<u4'), ('reserved', '<u4'), "
+		"('values', '<f4', (%u, %u))], 'fortran_order': False, 'shape': (%llu,), }",
+		header.maxChannels, header.fields, (unsigned long long) frames);
+	// magic, version and length take 10 bytes; pad so the data starts on a 64 byte boundary
+	size_t length = dict.size() + 1;
+	length += (64 - (10 + length) % 64) % 64;
+	dict.resize(length - 1, ' ');
+	dict += '\n';
+	uint16_t headerLength = length;
+	std::fwrite("\x93NUMPY\x01\x00", 1, 8, f);
+	std::fwrite(&headerLength, 2, 1, f);
+	std::fwrite(dict.data(), 1, dict.size(), f);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2)
+		return usage(argv[0]);
+	const char* path = argv[1];
+	uint64_t first = 0, count = UINT64_MAX;
+	std::string csvPath, npyPath;
+	for (int i = 2; i < argc; i++) {
+		if (!std::strcmp(argv[i], "--first") && i + 1 < argc)
+			first = std::strtoull(argv[++i], nullptr, 10);
+		else if (!std::strcmp(argv[i], "--count") && i + 1 < argc)
+			count = std::strtoull(argv[++i], nullptr, 10);
+		else if (!std::strcmp(argv[i], "--csv") && i + 1 < argc)
+			csvPath = argv[++i];
+		else if (!std::strcmp(argv[i], "--npy") && i + 1 < argc)
+			npyPath = argv[++i];
+		else
+			return usage(argv[0]);
+	}
+
+	FILE* in = std::fopen(path, "rb");
+	if (!in) {
+		std::fprintf(stderr, "cannot read %s\n", path);
+		return 1;
+	}
+	TraceHeader header;
+	if (std::fread(&header, sizeof(header), 1, in) != 1 || std::memcmp(header.magic, "ZCTRACE1", 8)
+		|| header.frameBytes != sizeof(TraceFrameHeader) + header.maxChannels*header.fields*sizeof(float)) {
+		std::fprintf(stderr, "%s is not a trace file\n", path);
+		return 1;
+	}
+	std::fseek(in, 0, SEEK_END);
+	uint64_t total = (std::ftell(in) - sizeof(header))/header.frameBytes;
+	first = std::min(first, total);
+	count = std::min(count, total - first);
+	std::fseek(in, sizeof(header) + first*header.frameBytes, SEEK_SET);
+
+	std::vector<std::string> names;
+	for (uint32_t i = 0; i < header.fields; i++)
+		names.push_back(std::string(header.fieldNames[i], strnlen(header.fieldNames[i], sizeof(header.fieldNames[i]))));
+
+	FILE* out = nullptr;
+	if (!csvPath.empty() || !npyPath.empty()) {
+		const std::string& outPath = csvPath.empty() ? npyPath : csvPath;
+		out = std::fopen(outPath.c_str(), "wb");
+		if (!out) {
+			std::fprintf(stderr, "cannot write %s\n", outPath.c_str());
+			return 1;
+		}
+	}
+	if (out && !csvPath.empty()) {
+		std::fprintf(out, "sample,channel");
+		for (const std::string& name : names)
+			std::fprintf(out, ",%s", name.c_str());
+		std::fprintf(out, "\n");
+	}
+	if (out && !npyPath.empty())
+		writeNpyHeader(out, header, count);
+
+	std::vector<char> frame(header.frameBytes);
+	uint64_t gaps = 0, missing = 0, previous = 0;
+	for (uint64_t i = 0; i < count && std::fread(frame.data(), header.frameBytes, 1, in) == 1; i++) {
+		const TraceFrameHeader* frameHeader = (const TraceFrameHeader*) frame.data();
+		const float* values = (const float*) (frame.data() + sizeof(TraceFrameHeader));
+		if (i > 0 && frameHeader->sample != previous + 1) {
+			gaps++;
+			missing += frameHeader->sample - previous - 1;
+		}
+		previous = frameHeader->sample;
+		if (out && !npyPath.empty())
+			std::fwrite(frame.data(), header.frameBytes, 1, out);
+		if (out && !csvPath.empty()) {
+			for (uint32_t c = 0; c < frameHeader->channels; c++) {
+				std::fprintf(out, "%llu,%u", (unsigned long long) frameHeader->sample, c);
+				for (uint32_t k = 0; k < header.fields; k++)
+					std::fprintf(out, ",%.9g", values[c*header.fields + k]);
+				std::fprintf(out, "\n");
+			}
+		}
+	}
+	if (out)
+		std::fclose(out);
+	std::fclose(in);
+
+	std::fprintf(stderr, "%s: %s at %.0f Hz, %u fields (", path, header.slug, header.sampleRate, header.fields);
+	for (size_t k = 0; k < names.size(); k++)
+		std::fprintf(stderr, "%s%s", k ? " " : "", names[k].c_str());
+	std::fprintf(stderr, "), %llu frames, read %llu from %llu, %llu gaps (%llu frames dropped)\n",
+		(unsigned long long) total, (unsigned long long) count, (unsigned long long) first,
+		(unsigned long long) gaps, (unsigned long long) missing);
+	return 0;
+}